@@ -55,10 +55,61 @@ public:
                      tp_data::Collection& collection,
                      const std::vector<std::string>& subset=std::vector<std::string>()) = 0;
 
+  //################################################################################################
+  //! Fetch a collection if it exists.
+  /*!
+  Unlike fetch() a missing collection is not treated as an error and the store is not modified.
+  The default implementation calls exists() then fetch().
+
+  \return true if the collection was found.
+  */
+  virtual bool tryFetch(const std::string& name,
+                        tp_data::Collection& collection,
+                        const std::vector<std::string>& subset=std::vector<std::string>());
+
+  //################################################################################################
+  //! Returns true if a collection with this name is in the store.
+  /*!
+  This must not modify the store. The default implementation searches the list from viewNames().
+  */
+  virtual bool exists(const std::string& name);
+
+  //################################################################################################
+  //! Hint that the named collections are about to be fetched.
+  /*!
+  Stores that have a slow backing medium can use this to start loading the collections in the
+  background, so that the latency overlaps with other work. This must return without waiting for
+  the data. The default implementation does nothing.
+
+  \param names - The names of the collections that are likely to be fetched soon.
+  */
+  virtual void prefetch(const std::vector<std::string>& names);
+
   //################################################################################################
   //! View the list of collection names that are currently in this store.
   virtual void viewNames(const std::function<void(const std::vector<std::string>&)>& closure) = 0;
 
+  //################################################################################################
+  //! Fetch a collection serialized for sending to another process, see StoreProtocol.h.
+  /*!
+  The default implementation calls tryFetch() and serializes the result with
+  saveCollectionToData(). Stores that already hold the saved files can pack them directly.
+
+  \param error - Set if the collection was found but could not be packed.
+  \return true if the collection was found.
+  */
+  virtual bool fetchPacked(std::string& error,
+                           const std::string& name,
+                           std::string& data,
+                           const std::vector<std::string>& subset=std::vector<std::string>());
+
+  //################################################################################################
+  //! Add members from data produced by fetchPacked() or saveCollectionToData().
+  /*!
+  The default implementation loads the data with loadCollectionFromData() and calls add().
+  */
+  virtual void addPacked(const std::string& name, const std::string& data);
+
 private:
   const tp_data::CollectionFactory* m_collectionFactory;
 };
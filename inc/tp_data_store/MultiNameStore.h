@@ -44,11 +44,27 @@ public:
   //################################################################################################
   const tp_data::CollectionFactory* collectionFactory() const;
 
+  //################################################################################################
+  //! Automatically prefetch the results of queries.
+  /*!
+  If enabled fetchNames() will call AbstractStore::prefetch() for the names that it returns, this
+  is off by default.
+  */
+  void setAutoPrefetch(bool autoPrefetch);
+
+  //################################################################################################
+  bool autoPrefetch() const;
+
   //################################################################################################
   //! Add members to a new or existing collection.
   void add(const std::vector<std::string>& names,
            const tp_data::Collection& collection);
 
+  //################################################################################################
+  //! Add members from packed data, see AbstractStore::addPacked().
+  void addPacked(const std::vector<std::string>& names,
+                 const std::string& data);
+
   //################################################################################################
   //! Remove a collection.
   void remove(const std::vector<std::string>& names);
@@ -59,12 +75,29 @@ public:
              tp_data::Collection& collection,
              const std::vector<std::string>& subset=std::vector<std::string>());
 
+  //################################################################################################
+  //! Fetch a collection that matches all names in order, if it exists.
+  /*!
+  \return true if the collection was found, misses do not modify the store.
+  */
+  bool tryFetch(const std::vector<std::string>& names,
+                tp_data::Collection& collection,
+                const std::vector<std::string>& subset=std::vector<std::string>());
+
+  //################################################################################################
+  //! Returns true if a collection that matches all names in order is in the store.
+  bool exists(const std::vector<std::string>& names);
+
   //################################################################################################
   //! Fetch all collections that match all of the names in andNames.
   void fetch(const std::vector<std::string>& andNames,
              std::vector<std::shared_ptr<CollectionFetchResults>>& collections,
              const std::vector<std::string>& subset=std::vector<std::string>());
 
+  //################################################################################################
+  //! Hint that the named collections are about to be fetched, see AbstractStore::prefetch().
+  void prefetch(const std::vector<MultiName>& multiNames);
+
   //################################################################################################
   //! View the list of collection names that are currently in this store.
   void viewNames(const std::function<void(const std::vector<MultiName>&)>& closure);
@@ -73,6 +106,14 @@ public:
   //! Fetch all names that match all of the names in andNames
   std::vector<MultiName> fetchNames(const std::vector<std::string>& andNames);
 
+  //################################################################################################
+  //! Split a name used in the underlying store back into the names it was compiled from.
+  /*!
+  \param name - A collection name from the underlying store.
+  \return The names, the name of the result only matches the input if it was a valid compiled name.
+  */
+  static MultiName parseName(const std::string& name);
+
 private:
   struct Private;
   friend struct Private;
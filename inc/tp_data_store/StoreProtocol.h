@@ -0,0 +1,191 @@
+#ifndef tp_data_store_StoreProtocol_h
+#define tp_data_store_StoreProtocol_h
+
+#include "tp_data_store/Globals.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tp_data
+{
+class Collection;
+class CollectionFactory;
+}
+
+namespace tp_data_store
+{
+
+//##################################################################################################
+//! The binary protocol used between StoreServer and RemoteStore.
+/*!
+Every message is a frame made of a uint32 length followed by that many bytes. Requests start with
+a uint32 request id and a uint8 StoreOp, responses start with the id of the request they answer and
+a uint8 StoreStatus. The rest of the frame is the payload described for each op.
+
+Integers are in host byte order, the protocol is only used over Unix domain and loopback sockets.
+Strings are a uint32 length followed by the bytes and lists are a uint32 count followed by the
+items.
+
+A client may send any number of requests before reading the responses, the server answers the
+requests from a connection in the order that they were received.
+*/
+enum class StoreOp : uint8_t
+{
+  Add        = 1, //!< Request: name, collection data. Response: empty.
+  Remove     = 2, //!< Request: name. Response: empty.
+  Fetch      = 3, //!< Request: name, subset. Response: collection data.
+  Exists     = 4, //!< Request: name. Response: empty, the status is NotFound for misses.
+  ViewNames  = 5, //!< Request: empty. Response: list of names.
+  FetchNames = 6  //!< Request: list of and names. Response: list of (name, list of names) pairs.
+};
+
+//##################################################################################################
+//! The largest frame that writeFrame() sends and readFrame() accepts.
+constexpr uint32_t maxFrameSize = 1u<<30;
+
+//##################################################################################################
+enum class StoreStatus : uint8_t
+{
+  OK       = 0,
+  NotFound = 1,
+  Error    = 2  //!< The payload is an error message.
+};
+
+//##################################################################################################
+//! Appends protocol values to a buffer.
+class ProtocolWriter
+{
+public:
+  //################################################################################################
+  ProtocolWriter(std::string& data);
+
+  //################################################################################################
+  void writeUInt8(uint8_t value);
+
+  //################################################################################################
+  void writeUInt32(uint32_t value);
+
+  //################################################################################################
+  void writeString(const std::string& value);
+
+  //################################################################################################
+  void writeStrings(const std::vector<std::string>& values);
+
+private:
+  std::string& m_data;
+};
+
+//##################################################################################################
+//! Reads protocol values from a buffer, once a read fails ok() will return false.
+class ProtocolReader
+{
+public:
+  //################################################################################################
+  ProtocolReader(const std::string& data);
+
+  //################################################################################################
+  uint8_t readUInt8();
+
+  //################################################################################################
+  uint32_t readUInt32();
+
+  //################################################################################################
+  std::string readString();
+
+  //################################################################################################
+  std::vector<std::string> readStrings();
+
+  //################################################################################################
+  bool ok() const;
+
+private:
+  const std::string& m_data;
+  size_t m_pos{0};
+  bool m_ok{true};
+};
+
+//##################################################################################################
+//! Open a listening socket.
+/*!
+\param error - Set if the socket could not be opened.
+\param address - Either "unix:<path>" or "tcp:<host>:<port>", the protocol is not authenticated
+so host must resolve to a loopback address and Unix sockets are only accessible to the owner.
+\return The socket file descriptor or -1 on failure.
+
+Sockets are only implemented on POSIX platforms, elsewhere this always fails with an error.
+*/
+int listenOnAddress(std::string& error, const std::string& address);
+
+//##################################################################################################
+//! Connect to a socket opened with listenOnAddress().
+int connectToAddress(std::string& error, const std::string& address);
+
+//##################################################################################################
+//! Remove the file of a Unix domain socket after the listening socket is closed.
+void removeSocketFile(const std::string& address);
+
+//##################################################################################################
+//! Wait for a connection on a socket opened with listenOnAddress().
+/*!
+\param listenFD - The listening socket.
+\param timeoutMS - The maximum time to wait in milliseconds.
+\return The connected socket or -1 if no connection arrived.
+*/
+int acceptConnection(int listenFD, int timeoutMS);
+
+//##################################################################################################
+//! Stop reads and writes on a socket, this wakes a thread blocked in readFrame().
+void shutdownSocket(int fd);
+
+//##################################################################################################
+void closeSocket(int fd);
+
+//##################################################################################################
+//! Write a frame, returns false if the connection failed.
+bool writeFrame(int fd, const std::string& frame);
+
+//##################################################################################################
+//! Read a frame, returns false if the connection failed or was closed.
+/*!
+Frames larger than maxFrameSize are rejected and the buffer grows as the data arrives, so a corrupt
+length can't allocate a large buffer up front.
+*/
+bool readFrame(int fd, std::string& frame);
+
+//##################################################################################################
+//! Pack the files below a directory into a buffer, this is how collections are sent.
+/*!
+\param path - The directory written by CollectionFactory::saveToPath().
+\param data - Set to a uint32 file count followed by a relative path and contents for each file.
+*/
+void packFiles(const std::string& path, std::string& data);
+
+//##################################################################################################
+//! Write the files packed with packFiles() to an existing directory.
+void unpackFiles(std::string& error, const std::string& data, const std::string& path);
+
+//##################################################################################################
+//! Serialize a collection to a buffer that can be sent over the protocol.
+/*!
+The collection is saved with CollectionFactory::saveToPath() to a temporary directory, in memory
+where possible, and the resulting files are packed into data, so any collection the factory can
+save can be sent. Stores that already hold the saved files should use packFiles() directly, see
+AbstractStore::fetchPacked().
+*/
+void saveCollectionToData(std::string& error,
+                          const tp_data::CollectionFactory* collectionFactory,
+                          const tp_data::Collection& collection,
+                          std::string& data);
+
+//##################################################################################################
+//! Load a collection saved with saveCollectionToData().
+void loadCollectionFromData(std::string& error,
+                            const tp_data::CollectionFactory* collectionFactory,
+                            const std::string& data,
+                            tp_data::Collection& collection,
+                            const std::vector<std::string>& subset=std::vector<std::string>());
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef tp_data_store_StoreServer_h
+#define tp_data_store_StoreServer_h
+
+#include "tp_data_store/Globals.h"
+
+namespace tp_data_store
+{
+class AbstractStore;
+class MultiNameStore;
+
+//##################################################################################################
+//! Serves a store to other processes, see RemoteStore for the client.
+/*!
+Listens on a Unix domain or loopback socket and answers requests using the protocol described in
+StoreProtocol.h. Each connection is handled by its own thread and requests on a connection are
+answered in order, so clients can pipeline requests. Access goes through the store so it uses the
+store's locks and in memory name list.
+
+If a MultiNameStore is provided it must wrap the same store. fetchNames() queries are answered from
+it and Add and Remove requests are routed through it so that its names stay current, local
+modifications should also go through it.
+*/
+class StoreServer
+{
+public:
+  //################################################################################################
+  /*!
+  \param store - The store to serve, this must outlive the server.
+  \param multiNameStore - Used to answer fetchNames() queries, can be nullptr.
+  \param address - Either "unix:<path>" or "tcp:<host>:<port>" where host is a loopback address.
+  */
+  StoreServer(AbstractStore* store,
+              MultiNameStore* multiNameStore,
+              const std::string& address);
+
+  //################################################################################################
+  //! Stops listening and closes all connections.
+  ~StoreServer();
+
+  //################################################################################################
+  //! Returns true if the server opened its socket.
+  bool isListening() const;
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
@@ -7,13 +7,48 @@ namespace tp_data_store
 {
 
 //##################################################################################################
-//! Stores collections in RAM.
+//! Statistics describing how well deduplication is working.
+struct DeduplicationStats
+{
+  size_t pooledFiles{0};     //!< The number of unique payloads used by the collections.
+  size_t referencedFiles{0}; //!< The number of member files in collections that use the pool.
+  size_t logicalBytes{0};    //!< The size the referencing files would use without deduplication.
+  size_t storedBytes{0};     //!< The size actually used by the pool.
+
+  //################################################################################################
+  //! logicalBytes / storedBytes, 1.0 means nothing has been saved.
+  double ratio() const
+  {
+    return storedBytes>0?double(logicalBytes)/double(storedBytes):1.0;
+  }
+};
+
+//##################################################################################################
+//! Stores collections in a directory on the file system.
 class FileSystemStore : public AbstractStore
 {
 public:
   //################################################################################################
+  //! How the collections are arranged in the directory.
+  enum class Layout
+  {
+    Directories, //!< Each collection is a directory that is written in place.
+    Versioned    //!< Each collection links to a version that is never modified, POSIX only.
+  };
+
+  //################################################################################################
+  /*!
+  \param collectionFactory - Used to serialize collections to the file system.
+  \param path - The directory that holds the collections.
+  \param layout - Versioned is needed for deduplication and checkpoints, a directory that already
+  has versions is always opened as Versioned.
+  \param shared - Set if other processes write to the same directory, implies Versioned. To share
+  collections between processes on one machine open a shared store in /dev/shm.
+  */
   FileSystemStore(const tp_data::CollectionFactory* collectionFactory,
-                  const std::string& path);
+                  const std::string& path,
+                  Layout layout=Layout::Directories,
+                  bool shared=false);
 
   //################################################################################################
   ~FileSystemStore() override;
@@ -30,9 +65,55 @@ public:
              tp_data::Collection& collection,
              const std::vector<std::string>& subset=std::vector<std::string>()) override;
 
+  //################################################################################################
+  bool tryFetch(const std::string& name,
+                tp_data::Collection& collection,
+                const std::vector<std::string>& subset=std::vector<std::string>()) override;
+
+  //################################################################################################
+  bool exists(const std::string& name) override;
+
+  //################################################################################################
+  //! Issue read-ahead for the files of the named collections on a background thread.
+  void prefetch(const std::vector<std::string>& names) override;
+
   //################################################################################################
   void viewNames(const std::function<void(const std::vector<std::string>&)>& closure) override;
 
+  //################################################################################################
+  //! Packs the files of the collection directly, with a subset it is loaded and packed again.
+  bool fetchPacked(std::string& error,
+                   const std::string& name,
+                   std::string& data,
+                   const std::vector<std::string>& subset=std::vector<std::string>()) override;
+
+  //################################################################################################
+  //! Unpacks the files directly into the store without loading the collection.
+  void addPacked(const std::string& name, const std::string& data) override;
+
+  //################################################################################################
+  //! Store identical member files of collections added from now on once, requires Versioned.
+  void setDeduplicate(bool deduplicate);
+
+  //################################################################################################
+  bool deduplicate() const;
+
+  //################################################################################################
+  //! Return statistics about how much space deduplication is saving in the current versions.
+  DeduplicationStats deduplicationStats();
+
+  //################################################################################################
+  //! Delete all unreferenced pool entries, only needed to clean up after crashed processes.
+  void collectGarbage();
+
+  //################################################################################################
+  //! Write a consistent point in time copy of the store to targetPath, requires Versioned.
+  /*!
+  \param targetPath - A new directory or a previous checkpoint, it can be opened as a store.
+  \return true on success.
+  */
+  bool checkpoint(const std::string& targetPath);
+
 private:
   struct Private;
   friend struct Private;
@@ -29,6 +29,14 @@ public:
              tp_data::Collection& collection,
              const std::vector<std::string>& subset=std::vector<std::string>()) override;
 
+  //################################################################################################
+  bool tryFetch(const std::string& name,
+                tp_data::Collection& collection,
+                const std::vector<std::string>& subset=std::vector<std::string>()) override;
+
+  //################################################################################################
+  bool exists(const std::string& name) override;
+
   //################################################################################################
   void viewNames(const std::function<void(const std::vector<std::string>&)>& closure) override;
 
@@ -0,0 +1,82 @@
+#ifndef tp_data_store_RemoteStore_h
+#define tp_data_store_RemoteStore_h
+
+#include "tp_data_store/AbstractStore.h"
+#include "tp_data_store/MultiNameStore.h"
+
+namespace tp_data_store
+{
+
+//##################################################################################################
+//! Accesses a store in another process that is being served by a StoreServer.
+/*!
+Connections are kept open and reused. Batches of fetches are pipelined, several requests are sent
+before waiting for the responses. prefetch() fetches collections in the background and keeps the
+results until they are fetched, for at most a couple of seconds. Prefetched data is discarded when
+this client adds, removes or fetches the same collection, so it never returns data older than its
+own writes, changes made by other clients may take up to the expiry time to be seen.
+*/
+class RemoteStore : public AbstractStore
+{
+public:
+  //################################################################################################
+  /*!
+  \param collectionFactory - Used to serialize collections, must match the server's factory.
+  \param address - The address passed to the StoreServer.
+  */
+  RemoteStore(const tp_data::CollectionFactory* collectionFactory,
+              const std::string& address);
+
+  //################################################################################################
+  ~RemoteStore() override;
+
+  //################################################################################################
+  void add(const std::string& name,
+           const tp_data::Collection& collection) override;
+
+  //################################################################################################
+  void remove(const std::string& name) override;
+
+  //################################################################################################
+  void fetch(const std::string& name,
+             tp_data::Collection& collection,
+             const std::vector<std::string>& subset=std::vector<std::string>()) override;
+
+  //################################################################################################
+  //! Fetch several collections with a single pipelined batch of requests.
+  /*!
+  \param names - The names of the collections to fetch.
+  \param collections - Resized to match names, entries are nullptr for missing collections.
+  \param subset - The members to fetch from each collection, empty for all.
+  */
+  void fetch(const std::vector<std::string>& names,
+             std::vector<std::shared_ptr<tp_data::Collection>>& collections,
+             const std::vector<std::string>& subset=std::vector<std::string>());
+
+  //################################################################################################
+  bool tryFetch(const std::string& name,
+                tp_data::Collection& collection,
+                const std::vector<std::string>& subset=std::vector<std::string>()) override;
+
+  //################################################################################################
+  bool exists(const std::string& name) override;
+
+  //################################################################################################
+  void prefetch(const std::vector<std::string>& names) override;
+
+  //################################################################################################
+  void viewNames(const std::function<void(const std::vector<std::string>&)>& closure) override;
+
+  //################################################################################################
+  //! Run a MultiNameStore::fetchNames() query on the server.
+  std::vector<MultiName> fetchNames(const std::vector<std::string>& andNames);
+
+private:
+  struct Private;
+  friend struct Private;
+  Private* d;
+};
+
+}
+
+#endif
@@ -1,7 +1,10 @@
 #include "tp_data_store/AbstractStore.h"
+#include "tp_data_store/StoreProtocol.h"
 
 #include "tp_data/Collection.h"
 
+#include "tp_utils/DebugUtils.h"
+
 namespace tp_data_store
 {
 
@@ -30,4 +33,62 @@ void AbstractStore::add(const std::string& name,
   add(name, collection);
 }
 
+//##################################################################################################
+bool AbstractStore::tryFetch(const std::string& name,
+                             tp_data::Collection& collection,
+                             const std::vector<std::string>& subset)
+{
+  if(!exists(name))
+    return false;
+
+  fetch(name, collection, subset);
+  return true;
+}
+
+//##################################################################################################
+bool AbstractStore::exists(const std::string& name)
+{
+  bool found=false;
+  viewNames([&](const std::vector<std::string>& names)
+  {
+    found = tpContains(names, name);
+  });
+  return found;
+}
+
+//##################################################################################################
+void AbstractStore::prefetch(const std::vector<std::string>& names)
+{
+  TP_UNUSED(names);
+}
+
+//##################################################################################################
+bool AbstractStore::fetchPacked(std::string& error,
+                                const std::string& name,
+                                std::string& data,
+                                const std::vector<std::string>& subset)
+{
+  tp_data::Collection collection;
+  if(!tryFetch(name, collection, subset))
+    return false;
+
+  saveCollectionToData(error, collectionFactory(), collection, data);
+  return true;
+}
+
+//##################################################################################################
+void AbstractStore::addPacked(const std::string& name, const std::string& data)
+{
+  std::string error;
+  tp_data::Collection collection;
+  loadCollectionFromData(error, collectionFactory(), data, collection);
+  if(!error.empty())
+  {
+    tpWarning() << "AbstractStore::addPacked Error: " << error;
+    return;
+  }
+
+  add(name, collection);
+}
+
 }
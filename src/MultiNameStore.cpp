@@ -7,6 +7,7 @@
 #include "tp_utils/MutexUtils.h"
 
 #include <unordered_map>
+#include <atomic>
 
 namespace tp_data_store
 {
@@ -69,6 +70,7 @@ struct MultiNameStore::Private
   TPMutex mutex{TPM};
   std::unordered_map<std::string, std::shared_ptr<TPMutex>> mutexes;
   std::vector<MultiName> multiNames;
+  std::atomic_bool autoPrefetch{false};
 
   //################################################################################################
   Private(AbstractStore* store_):
@@ -78,16 +80,7 @@ struct MultiNameStore::Private
     {
       multiNames.resize(names.size());
       for(size_t c=0; c<names.size(); c++)
-      {
-        const auto& name = names.at(c);
-        auto& multiName = multiNames.at(c);
-
-        std::vector<std::string> parts;
-        tpSplit(parts, name, '.');
-        for(auto& p : parts)
-          p = unEscapeName(p);
-        multiName = compileNames(parts);
-      }
+        multiNames.at(c) = MultiNameStore::parseName(names.at(c));
     });
   }
 
@@ -156,6 +149,18 @@ const tp_data::CollectionFactory* MultiNameStore::collectionFactory() const
   return d->store->collectionFactory();
 }
 
+//##################################################################################################
+void MultiNameStore::setAutoPrefetch(bool autoPrefetch)
+{
+  d->autoPrefetch = autoPrefetch;
+}
+
+//##################################################################################################
+bool MultiNameStore::autoPrefetch() const
+{
+  return d->autoPrefetch;
+}
+
 //##################################################################################################
 void MultiNameStore::add(const std::vector<std::string>& names,
                          const tp_data::Collection& collection)
@@ -165,10 +170,20 @@ void MultiNameStore::add(const std::vector<std::string>& names,
   d->store->add(multiName.name, collection);
 }
 
+//##################################################################################################
+void MultiNameStore::addPacked(const std::vector<std::string>& names,
+                               const std::string& data)
+{
+  auto multiName = d->compileNames(names);
+  TP_MUTEX_LOCKER(d->getMutex(multiName, NameAction::Add));
+  d->store->addPacked(multiName.name, data);
+}
+
 //##################################################################################################
 void MultiNameStore::remove(const std::vector<std::string>& names)
 {
   auto multiName = d->compileNames(names);
+  TP_MUTEX_LOCKER(d->getMutex(multiName, NameAction::Remove));
   d->store->remove(multiName.name);
 }
 
@@ -181,6 +196,22 @@ void MultiNameStore::fetch(const std::vector<std::string>& names,
   d->store->fetch(multiName.name, collection, subset);
 }
 
+//##################################################################################################
+bool MultiNameStore::tryFetch(const std::vector<std::string>& names,
+                              tp_data::Collection& collection,
+                              const std::vector<std::string>& subset)
+{
+  auto multiName = d->compileNames(names);
+  return d->store->tryFetch(multiName.name, collection, subset);
+}
+
+//##################################################################################################
+bool MultiNameStore::exists(const std::vector<std::string>& names)
+{
+  auto multiName = d->compileNames(names);
+  return d->store->exists(multiName.name);
+}
+
 //##################################################################################################
 void MultiNameStore::fetch(const std::vector<std::string>& andNames,
                            std::vector<std::shared_ptr<CollectionFetchResults>>& collections,
@@ -199,6 +230,16 @@ void MultiNameStore::fetch(const std::vector<std::string>& andNames,
   }
 }
 
+//##################################################################################################
+void MultiNameStore::prefetch(const std::vector<MultiName>& multiNames)
+{
+  std::vector<std::string> names;
+  names.reserve(multiNames.size());
+  for(const auto& multiName : multiNames)
+    names.push_back(multiName.name);
+  d->store->prefetch(names);
+}
+
 //##################################################################################################
 void MultiNameStore::viewNames(const std::function<void(const std::vector<MultiName>&)>& closure)
 {
@@ -210,24 +251,39 @@ void MultiNameStore::viewNames(const std::function<void(const std::vector<MultiN
 std::vector<MultiName> MultiNameStore::fetchNames(const std::vector<std::string>& andNames)
 {
   std::vector<MultiName> collectionNames;
-  TP_MUTEX_LOCKER(d->mutex);
-  for(const auto& multiName : d->multiNames)
   {
-    bool add=true;
-    for(const auto& n : andNames)
+    TP_MUTEX_LOCKER(d->mutex);
+    for(const auto& multiName : d->multiNames)
     {
-      if(!tpContains(multiName.names, n))
+      bool add=true;
+      for(const auto& n : andNames)
       {
-        add = false;
-        break;
+        if(!tpContains(multiName.names, n))
+        {
+          add = false;
+          break;
+        }
       }
-    }
 
-    if(add)
-      collectionNames.push_back(multiName);
+      if(add)
+        collectionNames.push_back(multiName);
+    }
   }
+
+  if(d->autoPrefetch && !collectionNames.empty())
+    prefetch(collectionNames);
+
   return collectionNames;
 }
 
+//##################################################################################################
+MultiName MultiNameStore::parseName(const std::string& name)
+{
+  std::vector<std::string> parts;
+  tpSplit(parts, name, '.');
+  for(auto& p : parts)
+    p = unEscapeName(p);
+  return Private::compileNames(parts);
+}
 
 }
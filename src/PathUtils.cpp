@@ -0,0 +1,428 @@
+#include "PathUtils.h"
+
+#include "tp_utils/FileUtils.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+
+namespace tp_data_store
+{
+
+namespace
+{
+//Files are streamed through a buffer of this size rather than being read into memory.
+constexpr size_t chunkSize = 64*1024;
+}
+
+//##################################################################################################
+std::vector<std::string> listFilesRecursive(const std::string& path)
+{
+  std::vector<std::string> files;
+
+#ifndef _WIN32
+  std::vector<std::string> directories{path};
+  while(!directories.empty())
+  {
+    std::string directory = directories.back();
+    directories.pop_back();
+
+    DIR* dir = opendir(directory.c_str());
+    if(!dir)
+      continue;
+
+    while(dirent* entry = readdir(dir))
+    {
+      std::string name = entry->d_name;
+      if(name == "." || name == "..")
+        continue;
+
+      std::string fullPath = directory + "/" + name;
+
+      struct stat s;
+      if(lstat(fullPath.c_str(), &s) != 0)
+        continue;
+
+      if(S_ISDIR(s.st_mode))
+        directories.push_back(fullPath);
+      else if(S_ISREG(s.st_mode))
+        files.push_back(fullPath);
+    }
+
+    closedir(dir);
+  }
+#else
+  TP_UNUSED(path);
+#endif
+
+  return files;
+}
+
+//##################################################################################################
+void readAhead(const std::vector<std::string>& paths)
+{
+#if defined(__linux__)
+  for(const auto& path : paths)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd<0)
+      continue;
+
+    //The kernel queues the reads and returns immediately, closing the file does not cancel them.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+  }
+#elif defined(__APPLE__)
+  for(const auto& path : paths)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd<0)
+      continue;
+
+    struct stat s;
+    if(fstat(fd, &s) == 0 && s.st_size>0)
+    {
+      radvisory advisory;
+      advisory.ra_offset = 0;
+      advisory.ra_count = int(std::min<off_t>(s.st_size, std::numeric_limits<int>::max()));
+      fcntl(fd, F_RDADVISE, &advisory);
+    }
+    close(fd);
+  }
+#else
+  TP_UNUSED(paths);
+#endif
+}
+
+//##################################################################################################
+std::string makeTempDirectory()
+{
+#ifdef __linux__
+  FileInfo info;
+  if(fileInfo("/dev/shm", info) && info.isDirectory)
+  {
+    std::string path = makeUniqueDirectory("/dev/shm/tp_data_store_tmp_");
+    if(!path.empty())
+      return path;
+  }
+#endif
+
+  const char* tmp = getenv("TMPDIR");
+  return makeUniqueDirectory(std::string((tmp && *tmp)?tmp:"/tmp") + "/tp_data_store_tmp_");
+}
+
+//##################################################################################################
+std::string makeUniqueDirectory(const std::string& prefix)
+{
+#ifndef _WIN32
+  std::string path = prefix + "XXXXXX";
+  if(!mkdtemp(&path[0]))
+    return std::string();
+  return path;
+#else
+  TP_UNUSED(prefix);
+  return std::string();
+#endif
+}
+
+//##################################################################################################
+std::vector<DirectoryEntry> listEntries(const std::string& path)
+{
+  std::vector<DirectoryEntry> entries;
+
+#ifndef _WIN32
+  DIR* dir = opendir(path.c_str());
+  if(!dir)
+    return entries;
+
+  while(dirent* e = readdir(dir))
+  {
+    DirectoryEntry entry;
+    entry.name = e->d_name;
+    if(entry.name == "." || entry.name == "..")
+      continue;
+
+    struct stat s;
+    if(lstat((path + "/" + entry.name).c_str(), &s) != 0)
+      continue;
+
+    entry.isDirectory = S_ISDIR(s.st_mode);
+    entry.isSymLink = S_ISLNK(s.st_mode);
+    entries.push_back(entry);
+  }
+
+  closedir(dir);
+#else
+  TP_UNUSED(path);
+#endif
+
+  return entries;
+}
+
+//##################################################################################################
+bool fileInfo(const std::string& path, FileInfo& info)
+{
+#ifndef _WIN32
+  struct stat s;
+  if(stat(path.c_str(), &s) != 0)
+    return false;
+
+  info.isDirectory = S_ISDIR(s.st_mode);
+  info.size = size_t(s.st_size);
+  info.links = size_t(s.st_nlink);
+  return true;
+#else
+  struct _stat64 s;
+  if(_stat64(path.c_str(), &s) != 0)
+    return false;
+
+  info.isDirectory = (s.st_mode & _S_IFDIR) != 0;
+  info.size = size_t(s.st_size);
+  info.links = size_t(s.st_nlink);
+  return true;
+#endif
+}
+
+//##################################################################################################
+bool hardLink(const std::string& existingPath, const std::string& newPath)
+{
+#ifndef _WIN32
+  return link(existingPath.c_str(), newPath.c_str()) == 0;
+#else
+  TP_UNUSED(existingPath);
+  TP_UNUSED(newPath);
+  return false;
+#endif
+}
+
+//##################################################################################################
+bool readFileChunks(const std::string& path,
+                    const std::function<bool(const char* data, size_t size)>& closure)
+{
+  std::ifstream in(path, std::ios::binary);
+  if(!in)
+    return false;
+
+  std::vector<char> buffer(chunkSize);
+  while(in)
+  {
+    in.read(buffer.data(), std::streamsize(buffer.size()));
+    auto count = size_t(in.gcount());
+    if(count>0 && !closure(buffer.data(), count))
+      return false;
+  }
+
+  return in.eof();
+}
+
+//##################################################################################################
+bool filesEqual(const std::string& pathA, const std::string& pathB)
+{
+  FileInfo infoA;
+  FileInfo infoB;
+  if(!fileInfo(pathA, infoA) || !fileInfo(pathB, infoB) || infoA.size!=infoB.size)
+    return false;
+
+  std::ifstream in(pathB, std::ios::binary);
+  if(!in)
+    return false;
+
+  std::vector<char> buffer(chunkSize);
+  return readFileChunks(pathA, [&](const char* data, size_t size)
+  {
+    in.read(buffer.data(), std::streamsize(size));
+    return size_t(in.gcount())==size && std::memcmp(data, buffer.data(), size)==0;
+  }) && in.peek()==std::ifstream::traits_type::eof();
+}
+
+//##################################################################################################
+bool cloneFile(const std::string& existingPath, const std::string& newPath)
+{
+  FileInfo info;
+  if(fileInfo(newPath, info))
+    return false;
+
+#if defined(__linux__) && defined(FICLONE)
+  int from = open(existingPath.c_str(), O_RDONLY);
+  if(from>=0)
+  {
+    bool cloned=false;
+    int to = open(newPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0664);
+    if(to>=0)
+    {
+      cloned = ioctl(to, FICLONE, from) == 0;
+      close(to);
+      if(!cloned)
+        unlink(newPath.c_str());
+    }
+    close(from);
+
+    if(cloned)
+      return true;
+  }
+#endif
+
+  if(!tp_utils::exists(existingPath))
+    return false;
+
+  std::ofstream out(newPath, std::ios::binary | std::ios::trunc);
+  bool ok = out && readFileChunks(existingPath, [&](const char* data, size_t size)
+  {
+    return bool(out.write(data, std::streamsize(size)));
+  });
+
+  out.close();
+  if(ok && !out.fail())
+    return true;
+
+  removeFile(newPath);
+  return false;
+}
+
+//##################################################################################################
+bool linkOrCloneFile(const std::string& existingPath, const std::string& newPath)
+{
+  return hardLink(existingPath, newPath) || cloneFile(existingPath, newPath);
+}
+
+//##################################################################################################
+bool renamePath(const std::string& oldPath, const std::string& newPath)
+{
+  return rename(oldPath.c_str(), newPath.c_str()) == 0;
+}
+
+//##################################################################################################
+bool exchangePaths(const std::string& pathA, const std::string& pathB)
+{
+#if defined(__linux__) && defined(SYS_renameat2) && defined(RENAME_EXCHANGE)
+  if(syscall(SYS_renameat2, AT_FDCWD, pathA.c_str(), AT_FDCWD, pathB.c_str(), RENAME_EXCHANGE) == 0)
+    return true;
+
+  //Not supported by all file systems, fall through to the renames.
+  if(errno != EINVAL && errno != ENOSYS)
+    return false;
+#endif
+
+  std::string swapPath = pathA + ".swap";
+  if(!renamePath(pathA, swapPath))
+    return false;
+
+  if(!renamePath(pathB, pathA))
+  {
+    renamePath(swapPath, pathA);
+    return false;
+  }
+
+  return renamePath(swapPath, pathB);
+}
+
+//##################################################################################################
+bool createSymLink(const std::string& target, const std::string& path)
+{
+#ifndef _WIN32
+  return symlink(target.c_str(), path.c_str()) == 0;
+#else
+  TP_UNUSED(target);
+  TP_UNUSED(path);
+  return false;
+#endif
+}
+
+//##################################################################################################
+std::string readSymLink(const std::string& path)
+{
+#ifndef _WIN32
+  char buffer[4096];
+  ssize_t size = readlink(path.c_str(), buffer, sizeof(buffer));
+  if(size<=0 || size_t(size)>=sizeof(buffer))
+    return std::string();
+  return std::string(buffer, size_t(size));
+#else
+  TP_UNUSED(path);
+  return std::string();
+#endif
+}
+
+//##################################################################################################
+bool removeFile(const std::string& path)
+{
+#ifndef _WIN32
+  return unlink(path.c_str()) == 0;
+#else
+  return remove(path.c_str()) == 0;
+#endif
+}
+
+//##################################################################################################
+int processID()
+{
+#ifndef _WIN32
+  return int(getpid());
+#else
+  return 0;
+#endif
+}
+
+//##################################################################################################
+bool processRunning(int pid)
+{
+#ifndef _WIN32
+  return pid>0 && (kill(pid_t(pid), 0) == 0 || errno == EPERM);
+#else
+  TP_UNUSED(pid);
+  return true;
+#endif
+}
+
+//##################################################################################################
+FileLock::FileLock(const std::string& path, bool exclusive, bool wait)
+{
+#ifndef _WIN32
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+  if(fd<0)
+    return;
+
+  int operation = (exclusive?LOCK_EX:LOCK_SH) | (wait?0:LOCK_NB);
+  int result=0;
+  while((result = flock(fd, operation)) != 0 && errno == EINTR){}
+  locked = (result == 0);
+#else
+  TP_UNUSED(path);
+  TP_UNUSED(exclusive);
+  TP_UNUSED(wait);
+  locked = true;
+#endif
+}
+
+//##################################################################################################
+FileLock::~FileLock()
+{
+#ifndef _WIN32
+  if(fd>=0)
+    close(fd);
+#endif
+}
+
+}
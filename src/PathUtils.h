@@ -0,0 +1,157 @@
+#ifndef tp_data_store_PathUtils_h
+#define tp_data_store_PathUtils_h
+
+#include "tp_data_store/Globals.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+//Internal file system helpers used by the stores, this header is not part of the public API. For
+//general file handling use tp_utils/FileUtils.h.
+
+namespace tp_data_store
+{
+
+//##################################################################################################
+//! Recursively list the regular files below a directory.
+/*!
+\param path - The directory to search.
+\return The full paths of the files found, the order is undefined.
+*/
+std::vector<std::string> listFilesRecursive(const std::string& path);
+
+//##################################################################################################
+//! Ask the OS to start reading files into the page cache.
+/*!
+This returns as soon as the requests have been issued, the actual reads happen in the background.
+On platforms that don't support read-ahead hints this does nothing.
+
+\param paths - The full paths of the files to read ahead.
+*/
+void readAhead(const std::vector<std::string>& paths);
+
+//##################################################################################################
+//! Create a new uniquely named empty directory for short lived files.
+/*!
+This is created in memory (/dev/shm) where available, otherwise in the system temp directory.
+
+\return The full path of the new directory or an empty string on failure.
+*/
+std::string makeTempDirectory();
+
+//##################################################################################################
+//! Create a new uniquely named empty directory, safe to call from several processes at once.
+/*!
+\param prefix - The full path of the new directory up to the random suffix.
+\return The full path of the new directory or an empty string on failure.
+*/
+std::string makeUniqueDirectory(const std::string& prefix);
+
+//##################################################################################################
+struct DirectoryEntry
+{
+  std::string name;
+  bool isDirectory{false}; //!< A real directory, symbolic links are not followed.
+  bool isSymLink{false};
+};
+
+//##################################################################################################
+//! List the entries of a single directory, excluding "." and "..".
+std::vector<DirectoryEntry> listEntries(const std::string& path);
+
+//##################################################################################################
+struct FileInfo
+{
+  bool isDirectory{false};
+  size_t size{0};  //!< The size of the file in bytes.
+  size_t links{0}; //!< The number of hard links to the file.
+};
+
+//##################################################################################################
+//! Get information about a file, returns false if it does not exist.
+bool fileInfo(const std::string& path, FileInfo& info);
+
+//##################################################################################################
+//! Create a new hard link to an existing file, fails if newPath exists.
+bool hardLink(const std::string& existingPath, const std::string& newPath);
+
+//##################################################################################################
+//! Read a file through a fixed size buffer, stops and returns false if closure returns false.
+bool readFileChunks(const std::string& path,
+                    const std::function<bool(const char* data, size_t size)>& closure);
+
+//##################################################################################################
+//! Returns true if both files can be read and have the same contents, compared in chunks.
+bool filesEqual(const std::string& pathA, const std::string& pathB);
+
+//##################################################################################################
+//! Copy a file, using a copy on write clone (reflink) where supported, fails if newPath exists.
+bool cloneFile(const std::string& existingPath, const std::string& newPath);
+
+//##################################################################################################
+//! Hard link a file, or copy it if a link is not possible, for example across file systems.
+bool linkOrCloneFile(const std::string& existingPath, const std::string& newPath);
+
+//##################################################################################################
+//! Atomically rename a file or directory, an existing file at newPath is replaced.
+bool renamePath(const std::string& oldPath, const std::string& newPath);
+
+//##################################################################################################
+//! Swap two paths, atomically where the platform supports it (renameat2 on Linux).
+/*!
+Where an atomic exchange is not available this falls back to two renames, in that case a crash
+between them leaves pathB missing and its content at pathA.
+*/
+bool exchangePaths(const std::string& pathA, const std::string& pathB);
+
+//##################################################################################################
+//! Create a symbolic link at path pointing to target, fails if path exists.
+bool createSymLink(const std::string& target, const std::string& path);
+
+//##################################################################################################
+//! Returns the target of a symbolic link or an empty string if path is not a link.
+std::string readSymLink(const std::string& path);
+
+//##################################################################################################
+//! Remove a file or symbolic link, a link is removed not its target.
+bool removeFile(const std::string& path);
+
+//##################################################################################################
+//! Returns the ID of the calling process.
+int processID();
+
+//##################################################################################################
+//! Returns false if it is known that no process with this ID is running.
+bool processRunning(int pid);
+
+//##################################################################################################
+//! Holds an advisory lock on a file that is visible to other processes, released on destruction.
+/*!
+A new file descriptor is opened for each lock so that threads in the same process also exclude
+each other, flock() locks belong to the open file description not the process. On platforms
+without flock() the lock is always reported as taken.
+*/
+struct FileLock
+{
+  //################################################################################################
+  /*!
+  \param path - The lock file, this is created if it does not exist.
+  \param exclusive - Take an exclusive lock rather than a shared one.
+  \param wait - Block until the lock is taken, if false check locked to see if it was.
+  */
+  FileLock(const std::string& path, bool exclusive, bool wait=true);
+
+  //################################################################################################
+  ~FileLock();
+
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+  int fd{-1};
+  bool locked{false};
+};
+
+}
+
+#endif
@@ -0,0 +1,594 @@
+#include "tp_data_store/StoreProtocol.h"
+#include "PathUtils.h"
+
+#include "tp_data/Collection.h"
+#include "tp_data/CollectionFactory.h"
+
+#include "tp_utils/FileUtils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace tp_data_store
+{
+
+namespace
+{
+//Frames are read in chunks of this size so memory is only allocated as the data arrives.
+constexpr size_t frameChunkSize = 1<<20;
+
+#ifndef _WIN32
+
+//##################################################################################################
+struct SocketAddress_lt
+{
+  bool isUnix{false};
+  std::string path;
+  std::string host;
+  std::string port;
+};
+
+//##################################################################################################
+bool parseAddress(std::string& error, const std::string& address, SocketAddress_lt& result)
+{
+  if(address.compare(0, 5, "unix:") == 0)
+  {
+    result.isUnix = true;
+    result.path = address.substr(5);
+    if(result.path.empty() || result.path.size() >= sizeof(sockaddr_un::sun_path))
+    {
+      error = "Invalid socket path: " + address;
+      return false;
+    }
+    return true;
+  }
+
+  if(address.compare(0, 4, "tcp:") == 0)
+  {
+    auto i = address.rfind(':');
+    result.host = address.substr(4, i-4);
+    result.port = address.substr(i+1);
+    if(i<4 || result.host.empty() || result.port.empty())
+    {
+      error = "Invalid tcp address: " + address;
+      return false;
+    }
+    return true;
+  }
+
+  error = "Address must start with unix: or tcp: " + address;
+  return false;
+}
+
+//##################################################################################################
+//! The protocol has no authentication so TCP is restricted to the loopback interface.
+bool isLoopback(const sockaddr* address)
+{
+  if(address->sa_family == AF_INET)
+  {
+    auto a = reinterpret_cast<const sockaddr_in*>(address);
+    return (ntohl(a->sin_addr.s_addr)>>24) == 127;
+  }
+
+  if(address->sa_family == AF_INET6)
+  {
+    const in6_addr& a = reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr;
+    return IN6_IS_ADDR_LOOPBACK(&a) || (IN6_IS_ADDR_V4MAPPED(&a) && a.s6_addr[12] == 127);
+  }
+
+  return false;
+}
+
+//##################################################################################################
+int openTCP(std::string& error, const SocketAddress_lt& address, bool listening)
+{
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo* results=nullptr;
+  int r = getaddrinfo(address.host.c_str(), address.port.c_str(), &hints, &results);
+  if(r!=0)
+  {
+    error = std::string("Failed to resolve address: ") + gai_strerror(r);
+    return -1;
+  }
+
+  int fd=-1;
+  for(addrinfo* a=results; a && fd<0; a=a->ai_next)
+  {
+    if(!isLoopback(a->ai_addr))
+    {
+      error = "Not a loopback address: " + address.host;
+      continue;
+    }
+
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if(fd<0)
+      continue;
+
+    int one=1;
+    if(listening)
+    {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if(bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+        break;
+    }
+    else
+    {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if(connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+        break;
+    }
+
+    error = strerror(errno);
+    close(fd);
+    fd=-1;
+  }
+
+  freeaddrinfo(results);
+  return fd;
+}
+
+//##################################################################################################
+//! Returns true if there is a socket file at path.
+bool isSocketFile(const std::string& path)
+{
+  struct stat info;
+  return lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode);
+}
+
+//##################################################################################################
+//! Remove a socket left by a server that has gone, never a live one or a file that is not a socket.
+bool removeStaleSocket(std::string& error, const sockaddr_un& addr, const std::string& path)
+{
+  struct stat info;
+  if(lstat(path.c_str(), &info) != 0)
+    return true;
+
+  if(!S_ISSOCK(info.st_mode))
+  {
+    error = "Not a socket: " + path;
+    return false;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  bool live = fd>=0 && connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+  if(fd>=0)
+    close(fd);
+
+  if(live)
+  {
+    error = "Address already in use: " + path;
+    return false;
+  }
+
+  unlink(path.c_str());
+  return true;
+}
+
+//##################################################################################################
+int openUnix(std::string& error, const SocketAddress_lt& address, bool listening)
+{
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, address.path.data(), address.path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd<0)
+  {
+    error = strerror(errno);
+    return -1;
+  }
+
+  bool ok=false;
+  if(listening)
+  {
+    if(!removeStaleSocket(error, addr, address.path))
+    {
+      close(fd);
+      return -1;
+    }
+
+    //The protocol is not authenticated so only the owner may connect. Connections are refused
+    //until listen() so there is no window where the wider default mode can be used.
+    ok = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+        chmod(address.path.c_str(), 0600) == 0 &&
+        listen(fd, SOMAXCONN) == 0;
+  }
+  else
+    ok = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+
+  if(!ok)
+  {
+    error = strerror(errno);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+//##################################################################################################
+int openAddress(std::string& error, const std::string& address, bool listening)
+{
+  SocketAddress_lt a;
+  if(!parseAddress(error, address, a))
+    return -1;
+
+  return a.isUnix?openUnix(error, a, listening):openTCP(error, a, listening);
+}
+
+//##################################################################################################
+bool readAll(int fd, char* data, size_t size)
+{
+  while(size>0)
+  {
+    ssize_t n = recv(fd, data, size, 0);
+    if(n<0 && errno == EINTR)
+      continue;
+    if(n<=0)
+      return false;
+    data += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+//##################################################################################################
+bool writeAll(int fd, const char* data, size_t size)
+{
+#ifdef MSG_NOSIGNAL
+  int flags = MSG_NOSIGNAL;
+#else
+  int flags = 0;
+#endif
+
+  while(size>0)
+  {
+    ssize_t n = send(fd, data, size, flags);
+    if(n<0 && errno == EINTR)
+      continue;
+    if(n<=0)
+      return false;
+    data += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+#else
+
+//##################################################################################################
+int openAddress(std::string& error, const std::string& address, bool listening)
+{
+  TP_UNUSED(address);
+  TP_UNUSED(listening);
+  error = "Sockets are not supported on this platform.";
+  return -1;
+}
+
+//##################################################################################################
+bool readAll(int fd, char* data, size_t size)
+{
+  TP_UNUSED(fd);
+  TP_UNUSED(data);
+  TP_UNUSED(size);
+  return false;
+}
+
+//##################################################################################################
+bool writeAll(int fd, const char* data, size_t size)
+{
+  TP_UNUSED(fd);
+  TP_UNUSED(data);
+  TP_UNUSED(size);
+  return false;
+}
+
+#endif
+}
+
+//##################################################################################################
+ProtocolWriter::ProtocolWriter(std::string& data):
+  m_data(data)
+{
+
+}
+
+//##################################################################################################
+void ProtocolWriter::writeUInt8(uint8_t value)
+{
+  m_data.push_back(char(value));
+}
+
+//##################################################################################################
+void ProtocolWriter::writeUInt32(uint32_t value)
+{
+  m_data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+//##################################################################################################
+void ProtocolWriter::writeString(const std::string& value)
+{
+  writeUInt32(uint32_t(value.size()));
+  m_data.append(value);
+}
+
+//##################################################################################################
+void ProtocolWriter::writeStrings(const std::vector<std::string>& values)
+{
+  writeUInt32(uint32_t(values.size()));
+  for(const auto& value : values)
+    writeString(value);
+}
+
+//##################################################################################################
+ProtocolReader::ProtocolReader(const std::string& data):
+  m_data(data)
+{
+
+}
+
+//##################################################################################################
+uint8_t ProtocolReader::readUInt8()
+{
+  if(!m_ok || m_pos+1>m_data.size())
+  {
+    m_ok = false;
+    return 0;
+  }
+
+  return uint8_t(m_data.at(m_pos++));
+}
+
+//##################################################################################################
+uint32_t ProtocolReader::readUInt32()
+{
+  uint32_t value=0;
+  if(!m_ok || m_pos+sizeof(value)>m_data.size())
+  {
+    m_ok = false;
+    return 0;
+  }
+
+  memcpy(&value, m_data.data()+m_pos, sizeof(value));
+  m_pos += sizeof(value);
+  return value;
+}
+
+//##################################################################################################
+std::string ProtocolReader::readString()
+{
+  size_t size = readUInt32();
+  if(!m_ok || m_pos+size>m_data.size())
+  {
+    m_ok = false;
+    return std::string();
+  }
+
+  std::string value = m_data.substr(m_pos, size);
+  m_pos += size;
+  return value;
+}
+
+//##################################################################################################
+std::vector<std::string> ProtocolReader::readStrings()
+{
+  std::vector<std::string> values;
+  size_t count = readUInt32();
+  for(size_t i=0; i<count && m_ok; i++)
+    values.push_back(readString());
+  return values;
+}
+
+//##################################################################################################
+bool ProtocolReader::ok() const
+{
+  return m_ok;
+}
+
+//##################################################################################################
+int listenOnAddress(std::string& error, const std::string& address)
+{
+  return openAddress(error, address, true);
+}
+
+//##################################################################################################
+int connectToAddress(std::string& error, const std::string& address)
+{
+  return openAddress(error, address, false);
+}
+
+//##################################################################################################
+void removeSocketFile(const std::string& address)
+{
+#ifndef _WIN32
+  std::string error;
+  SocketAddress_lt a;
+  if(parseAddress(error, address, a) && a.isUnix && isSocketFile(a.path))
+    unlink(a.path.c_str());
+#else
+  TP_UNUSED(address);
+#endif
+}
+
+//##################################################################################################
+int acceptConnection(int listenFD, int timeoutMS)
+{
+#ifndef _WIN32
+  pollfd p;
+  p.fd = listenFD;
+  p.events = POLLIN;
+  p.revents = 0;
+
+  if(poll(&p, 1, timeoutMS)<=0)
+    return -1;
+
+  return accept(listenFD, nullptr, nullptr);
+#else
+  TP_UNUSED(listenFD);
+  TP_UNUSED(timeoutMS);
+  return -1;
+#endif
+}
+
+//##################################################################################################
+void shutdownSocket(int fd)
+{
+#ifndef _WIN32
+  shutdown(fd, SHUT_RDWR);
+#else
+  TP_UNUSED(fd);
+#endif
+}
+
+//##################################################################################################
+void closeSocket(int fd)
+{
+#ifndef _WIN32
+  close(fd);
+#else
+  TP_UNUSED(fd);
+#endif
+}
+
+//##################################################################################################
+bool writeFrame(int fd, const std::string& frame)
+{
+  if(frame.size()>maxFrameSize)
+    return false;
+
+  uint32_t size = uint32_t(frame.size());
+  return writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) &&
+      writeAll(fd, frame.data(), frame.size());
+}
+
+//##################################################################################################
+bool readFrame(int fd, std::string& frame)
+{
+  uint32_t size=0;
+  if(!readAll(fd, reinterpret_cast<char*>(&size), sizeof(size)) || size>maxFrameSize)
+    return false;
+
+  frame.clear();
+  while(frame.size()<size)
+  {
+    size_t offset = frame.size();
+    size_t chunk = std::min(frameChunkSize, size_t(size)-offset);
+    frame.resize(offset+chunk);
+    if(!readAll(fd, &frame[offset], chunk))
+      return false;
+  }
+  return true;
+}
+
+//##################################################################################################
+void packFiles(const std::string& path, std::string& data)
+{
+  data.clear();
+
+  std::vector<std::string> files = listFilesRecursive(path);
+  ProtocolWriter writer(data);
+  writer.writeUInt32(uint32_t(files.size()));
+  for(const auto& file : files)
+  {
+    writer.writeString(file.substr(path.size()+1));
+    writer.writeString(tp_utils::readBinaryFile(file));
+  }
+}
+
+//##################################################################################################
+void unpackFiles(std::string& error, const std::string& data, const std::string& path)
+{
+  ProtocolReader reader(data);
+  size_t count = reader.readUInt32();
+  for(size_t i=0; i<count && reader.ok() && error.empty(); i++)
+  {
+    std::string relativePath = reader.readString();
+    std::string contents = reader.readString();
+
+    if(relativePath.empty() ||
+       relativePath.front()=='/' ||
+       relativePath.find("..") != std::string::npos)
+    {
+      error = "Invalid path in collection data: " + relativePath;
+      break;
+    }
+
+    std::string file = path + "/" + relativePath;
+    auto slash = file.rfind('/');
+    if(!tp_utils::mkdir(file.substr(0, slash), tp_utils::CreateFullPath::Yes) ||
+       !tp_utils::writeBinaryFile(file, contents))
+      error = "Failed to write: " + file;
+  }
+
+  if(!reader.ok())
+    error = "Truncated collection data.";
+}
+
+//##################################################################################################
+void saveCollectionToData(std::string& error,
+                          const tp_data::CollectionFactory* collectionFactory,
+                          const tp_data::Collection& collection,
+                          std::string& data)
+{
+  data.clear();
+
+  std::string tempPath = makeTempDirectory();
+  if(tempPath.empty())
+  {
+    error = "Failed to create temp directory.";
+    return;
+  }
+
+  std::string collectionPath = tempPath + "/c";
+  collectionFactory->saveToPath(error, collection, collectionPath, true);
+
+  if(error.empty())
+    packFiles(collectionPath, data);
+
+  tp_utils::rm(tempPath, true);
+}
+
+//##################################################################################################
+void loadCollectionFromData(std::string& error,
+                            const tp_data::CollectionFactory* collectionFactory,
+                            const std::string& data,
+                            tp_data::Collection& collection,
+                            const std::vector<std::string>& subset)
+{
+  std::string tempPath = makeTempDirectory();
+  if(tempPath.empty())
+  {
+    error = "Failed to create temp directory.";
+    return;
+  }
+
+  std::string collectionPath = tempPath + "/c";
+  tp_utils::mkdir(collectionPath, tp_utils::CreateFullPath::Yes);
+
+  unpackFiles(error, data, collectionPath);
+
+  if(error.empty())
+    collectionFactory->loadFromPath(error, collectionPath, collection, subset);
+
+  tp_utils::rm(tempPath, true);
+}
+
+}
@@ -0,0 +1,306 @@
+#include "tp_data_store/StoreServer.h"
+#include "tp_data_store/StoreProtocol.h"
+#include "tp_data_store/AbstractStore.h"
+#include "tp_data_store/MultiNameStore.h"
+
+#include "tp_utils/MutexUtils.h"
+#include "tp_utils/DebugUtils.h"
+
+#include <atomic>
+#include <thread>
+#include <memory>
+
+namespace tp_data_store
+{
+
+namespace
+{
+//The request id and status at the start of each response.
+constexpr size_t responseHeaderSize = sizeof(uint32_t) + sizeof(uint8_t);
+
+//##################################################################################################
+struct Connection_lt
+{
+  int fd{-1};
+  std::thread thread;
+  std::atomic_bool done{false};
+};
+}
+
+//##################################################################################################
+struct StoreServer::Private
+{
+  AbstractStore* store;
+  MultiNameStore* multiNameStore;
+  std::string address;
+
+  int listenFD{-1};
+  std::atomic_bool finish{false};
+  std::unique_ptr<std::thread> acceptThread;
+
+  TPMutex mutex{TPM};
+  std::vector<std::unique_ptr<Connection_lt>> connections;
+
+  //################################################################################################
+  Private(AbstractStore* store_, MultiNameStore* multiNameStore_, const std::string& address_):
+    store(store_),
+    multiNameStore(multiNameStore_),
+    address(address_)
+  {
+
+  }
+
+  //################################################################################################
+  void runAccept()
+  {
+    while(!finish)
+    {
+      //Wake up periodically to check finish.
+      int fd = acceptConnection(listenFD, 100);
+      if(fd<0)
+        continue;
+
+      TP_MUTEX_LOCKER(mutex);
+      removeFinishedConnections();
+
+      connections.emplace_back(new Connection_lt());
+      auto connection = connections.back().get();
+      connection->fd = fd;
+      connection->thread = std::thread([this, connection]
+      {
+        runConnection(connection->fd);
+        connection->done = true;
+      });
+    }
+  }
+
+  //################################################################################################
+  //! Must be called with mutex locked.
+  void removeFinishedConnections()
+  {
+    for(size_t i=connections.size()-1; i<connections.size(); i--)
+    {
+      auto& connection = connections.at(i);
+      if(connection->done)
+      {
+        connection->thread.join();
+        closeSocket(connection->fd);
+        tpRemoveAt(connections, i);
+      }
+    }
+  }
+
+  //################################################################################################
+  void runConnection(int fd)
+  {
+    std::string request;
+    std::string response;
+    while(!finish && readFrame(fd, request))
+    {
+      handleRequest(request, response);
+      if(!writeFrame(fd, response))
+        break;
+    }
+  }
+
+  //################################################################################################
+  //! Modifications go through the MultiNameStore so the name must be one it could have compiled.
+  bool checkName(std::string& error, const std::string& name, MultiName& multiName)
+  {
+    if(!multiNameStore)
+      return true;
+
+    multiName = MultiNameStore::parseName(name);
+    if(multiName.name == name)
+      return true;
+
+    error = "Not a valid MultiNameStore name: " + name;
+    return false;
+  }
+
+  //################################################################################################
+  void handleRequest(const std::string& request, std::string& response)
+  {
+    response.clear();
+
+    ProtocolReader reader(request);
+    uint32_t id = reader.readUInt32();
+    auto op = StoreOp(reader.readUInt8());
+
+    std::string payload;
+    ProtocolWriter writer(payload);
+    StoreStatus status = StoreStatus::OK;
+    std::string error;
+
+    switch(op)
+    {
+    case StoreOp::Add:
+    {
+      std::string name = reader.readString();
+      std::string data = reader.readString();
+      if(!reader.ok())
+        break;
+
+      MultiName multiName;
+      if(!checkName(error, name, multiName))
+        break;
+
+      if(multiNameStore)
+        multiNameStore->addPacked(multiName.names, data);
+      else
+        store->addPacked(name, data);
+      break;
+    }
+
+    case StoreOp::Remove:
+    {
+      std::string name = reader.readString();
+      MultiName multiName;
+      if(!reader.ok() || !checkName(error, name, multiName))
+        break;
+
+      if(multiNameStore)
+        multiNameStore->remove(multiName.names);
+      else
+        store->remove(name);
+      break;
+    }
+
+    case StoreOp::Fetch:
+    {
+      std::string name = reader.readString();
+      std::vector<std::string> subset = reader.readStrings();
+      if(!reader.ok())
+        break;
+
+      std::string data;
+      if(!store->fetchPacked(error, name, data, subset))
+      {
+        status = StoreStatus::NotFound;
+        break;
+      }
+
+      if(error.empty())
+        writer.writeString(data);
+      break;
+    }
+
+    case StoreOp::Exists:
+    {
+      std::string name = reader.readString();
+      if(reader.ok() && !store->exists(name))
+        status = StoreStatus::NotFound;
+      break;
+    }
+
+    case StoreOp::ViewNames:
+    {
+      store->viewNames([&](const std::vector<std::string>& names)
+      {
+        writer.writeStrings(names);
+      });
+      break;
+    }
+
+    case StoreOp::FetchNames:
+    {
+      std::vector<std::string> andNames = reader.readStrings();
+      if(!reader.ok())
+        break;
+
+      if(!multiNameStore)
+      {
+        error = "No MultiNameStore is being served.";
+        break;
+      }
+
+      std::vector<MultiName> multiNames = multiNameStore->fetchNames(andNames);
+      writer.writeUInt32(uint32_t(multiNames.size()));
+      for(const auto& multiName : multiNames)
+      {
+        writer.writeString(multiName.name);
+        writer.writeStrings(multiName.names);
+      }
+      break;
+    }
+
+    default:
+      error = "Unknown op: " + std::to_string(int(op));
+      break;
+    }
+
+    if(!reader.ok())
+      error = "Malformed request.";
+
+    //writeFrame() would fail and drop the connection without telling the client why.
+    if(error.empty() && payload.size()>maxFrameSize-responseHeaderSize)
+      error = "Response too large to send: " + std::to_string(payload.size()) + " bytes.";
+
+    ProtocolWriter responseWriter(response);
+    responseWriter.writeUInt32(id);
+    if(!error.empty())
+    {
+      responseWriter.writeUInt8(uint8_t(StoreStatus::Error));
+      responseWriter.writeString(error);
+    }
+    else
+    {
+      responseWriter.writeUInt8(uint8_t(status));
+      response += payload;
+    }
+  }
+};
+
+//##################################################################################################
+StoreServer::StoreServer(AbstractStore* store,
+                         MultiNameStore* multiNameStore,
+                         const std::string& address):
+  d(new Private(store, multiNameStore, address))
+{
+  std::string error;
+  d->listenFD = listenOnAddress(error, address);
+  if(d->listenFD<0)
+  {
+    tpWarning() << "StoreServer failed to listen on: " << address << " Error: " << error;
+    return;
+  }
+
+  d->acceptThread.reset(new std::thread([&]{d->runAccept();}));
+}
+
+//##################################################################################################
+StoreServer::~StoreServer()
+{
+  d->finish = true;
+
+  if(d->acceptThread)
+    d->acceptThread->join();
+
+  {
+    TP_MUTEX_LOCKER(d->mutex);
+    for(const auto& connection : d->connections)
+      shutdownSocket(connection->fd);
+  }
+
+  for(const auto& connection : d->connections)
+  {
+    connection->thread.join();
+    closeSocket(connection->fd);
+  }
+
+  if(d->listenFD>=0)
+  {
+    closeSocket(d->listenFD);
+    removeSocketFile(d->address);
+  }
+
+  delete d;
+}
+
+//##################################################################################################
+bool StoreServer::isListening() const
+{
+  return d->listenFD>=0;
+}
+
+}
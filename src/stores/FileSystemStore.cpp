@@ -1,4 +1,6 @@
 #include "tp_data_store/stores/FileSystemStore.h"
+#include "tp_data_store/StoreProtocol.h"
+#include "../PathUtils.h"
 
 #include "tp_data/CollectionFactory.h"
 
@@ -7,73 +9,833 @@
 #include "tp_utils/DebugUtils.h"
 
 #include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+
+//The versioned layout: each collection name is a symbolic link to a directory in .versions that is
+//never modified. add() builds a new version from links to the files of the current one plus the
+//new members and atomically replaces the link, so readers and checkpoints never see a partial
+//write. Readers hold a shared flock on <version>.lock and replaced versions are deleted once their
+//readers have finished. A checkpoint excludes writers only while it reads which version each name
+//points to, it then links those versions into targetPath.partial and exchanges it with the
+//previous checkpoint.
+//
+//With deduplication identical files are stored once in .pool and versions hold hard links to the
+//pool entries, <version>.refs lists the entries a version uses so they can be released when it
+//is deleted. Links from checkpoints keep pool entries alive.
 
 namespace tp_data_store
 {
 
+namespace
+{
+//Prefetch requests beyond this are dropped, read-ahead that lags far behind the fetches is useless.
+constexpr size_t maxPrefetchQueue = 1024;
+
+//Maps the path of a file in a version, relative to the version, to the pool entry it links to.
+using PoolRefs = std::unordered_map<std::string, std::string>;
+
+//##################################################################################################
+//! The name of the pool entry for a file, this needs to be stable between runs so FNV-1a is used.
+/*!
+\return false if the file could not be read or is empty, empty files are not pooled.
+*/
+bool poolName(const std::string& file, std::string& name)
+{
+  uint64_t hash = 14695981039346656037ull;
+  size_t size=0;
+  bool ok = readFileChunks(file, [&](const char* data, size_t count)
+  {
+    for(size_t i=0; i<count; i++)
+    {
+      hash ^= uint64_t(uint8_t(data[i]));
+      hash *= 1099511628211ull;
+    }
+    size += count;
+    return true;
+  });
+
+  if(!ok || size==0)
+    return false;
+
+  char buffer[17];
+  snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+  name = std::string(buffer) + "_" + std::to_string(size);
+  return true;
+}
+
+//##################################################################################################
+//! Returns the last part of a path.
+std::string fileName(const std::string& path)
+{
+  std::vector<std::string> parts;
+  tpSplit(parts, path, '/', tp_utils::SplitBehavior::SkipEmptyParts);
+  return parts.empty()?std::string():parts.back();
+}
+
+//##################################################################################################
+//! Names starting with a '.' are used internally and are never valid collection names.
+bool validName(const std::string& name)
+{
+  return !name.empty() && name.front()!='.' && name.find('/') == std::string::npos;
+}
+
+//##################################################################################################
+bool makeParentDirectory(const std::string& file)
+{
+  std::string directory = file.substr(0, file.rfind('/'));
+  FileInfo info;
+  if(fileInfo(directory, info))
+    return info.isDirectory;
+  return tp_utils::mkdir(directory, tp_utils::CreateFullPath::Yes);
+}
+
+//##################################################################################################
+//! Link the files below sourcePath into targetPath, replacing files that already exist.
+bool linkTree(const std::string& sourcePath, const std::string& targetPath)
+{
+  for(const auto& file : listFilesRecursive(sourcePath))
+  {
+    std::string targetFile = targetPath + file.substr(sourcePath.size());
+    if(!makeParentDirectory(targetFile))
+      return false;
+
+    removeFile(targetFile);
+    if(!linkOrCloneFile(file, targetFile))
+      return false;
+  }
+  return true;
+}
+
+//##################################################################################################
+//! Move the files below sourcePath into targetPath, replacing files that already exist.
+bool moveTree(const std::string& sourcePath, const std::string& targetPath)
+{
+  for(const auto& file : listFilesRecursive(sourcePath))
+  {
+    std::string targetFile = targetPath + file.substr(sourcePath.size());
+    if(!makeParentDirectory(targetFile) || !renamePath(file, targetFile))
+      return false;
+  }
+  return true;
+}
+}
+
 //##################################################################################################
 struct FileSystemStore::Private
 {
   TPMutex mutex{TPM};
   std::unordered_map<std::string, std::shared_ptr<TPMutex>> mutexes;
   std::string path;
+  bool versioned{false};
+  bool shared;
   std::vector<std::string> names;
+  std::unordered_set<std::string> nameSet;
+
+  std::atomic_bool deduplicate{false};
+  std::atomic_bool usesPool{false};
+
+  //Versions that have been replaced but may still be in use by a reader.
+  TPMutex retiredMutex{TPM};
+  std::vector<std::string> retired;
+  std::atomic_bool hasRetired{false};
+
+  TPMutex prefetchMutex{TPM};
+  TPWaitCondition prefetchWaitCondition;
+  std::deque<std::string> prefetchQueue;
+  std::unordered_set<std::string> prefetchQueued;
+  std::unique_ptr<std::thread> prefetchThread;
+  bool finish{false};
 
   //################################################################################################
-  Private(const std::string& path_):
+  Private(const std::string& path_, Layout layout, bool shared_):
     path(path_),
-    names(tp_utils::listDirectories(path))
+    shared(shared_)
+  {
+#ifdef _WIN32
+    if(layout==Layout::Versioned || shared || tp_utils::exists(versionsPath()))
+      tpWarning() << "FileSystemStore versions are not supported on this platform: " << path;
+#else
+    versioned = tp_utils::exists(versionsPath());
+    if(!versioned && (layout==Layout::Versioned || shared))
+    {
+      versioned = tp_utils::mkdir(versionsPath(), tp_utils::CreateFullPath::Yes);
+      if(!versioned)
+        tpWarning() << "FileSystemStore failed to create versions, using directories: " << path;
+    }
+#endif
+
+    if(versioned)
+      openVersions();
+
+    if(!shared)
+    {
+      names = listCollections();
+      nameSet.insert(names.begin(), names.end());
+    }
+
+    FileInfo info;
+    usesPool = fileInfo(poolPath(), info);
+  }
+
+  //################################################################################################
+  //! Tidy up after crashed processes and move plain directories into versions.
+  /*!
+  Nothing here is required for reading, if the store is read only the collections that have not
+  been moved are read from their directories.
+  */
+  void openVersions()
+  {
+    if(!tp_utils::exists(stagingPath()))
+      tp_utils::mkdir(stagingPath(), tp_utils::CreateFullPath::Yes);
+
+    //Staging directories are only removed once the process that created them has gone, they may
+    //belong to another store open on the same path.
+    for(const auto& entry : listEntries(stagingPath()))
+      if(!processRunning(std::atoi(entry.name.c_str())))
+        tp_utils::rm(stagingPath() + "/" + entry.name, true);
+
+    FileLock writeLock(writeLockPath(), true);
+    if(!writeLock.locked)
+      return;
+
+    recoverVersions();
+    migrateDirectories();
+
+    //Links are only created while holding the write lock, any that exist now are from a crash.
+    for(const auto& entry : listEntries(path))
+      if(entry.isSymLink && entry.name.compare(0, 6, ".link_") == 0)
+        removeFile(getPath(entry.name));
+
+    FileLock checkpointLock(checkpointLockPath(), true, false);
+    if(checkpointLock.locked)
+      removeUnreferencedVersions();
+  }
+
+  //################################################################################################
+  ~Private()
   {
-    for(auto& name : names)
     {
-      std::vector<std::string> parts;
-      tpSplit(parts, name, '/', tp_utils::SplitBehavior::SkipEmptyParts);
-      if(!parts.empty())
-        name = parts.back();
+      TP_MUTEX_LOCKER(prefetchMutex);
+      finish = true;
     }
+    prefetchWaitCondition.wakeAll();
+
+    if(prefetchThread)
+      prefetchThread->join();
+
+    deleteRetired();
   }
 
   //################################################################################################
-  std::string getPath(const std::string& name)
+  void queuePrefetch(const std::vector<std::string>& prefetchNames)
+  {
+    {
+      TP_MUTEX_LOCKER(prefetchMutex);
+      for(const auto& name : prefetchNames)
+        if(prefetchQueue.size()<maxPrefetchQueue && prefetchQueued.insert(name).second)
+          prefetchQueue.push_back(name);
+
+      if(!prefetchThread)
+        prefetchThread.reset(new std::thread([&]{runPrefetch();}));
+    }
+    prefetchWaitCondition.wakeAll();
+  }
+
+  //################################################################################################
+  void runPrefetch()
+  {
+    TP_MUTEX_LOCKER(prefetchMutex);
+    for(;;)
+    {
+      while(!finish && prefetchQueue.empty())
+        prefetchWaitCondition.wait(TPMc prefetchMutex);
+
+      if(finish)
+        return;
+
+      std::string name = prefetchQueue.front();
+      prefetchQueue.pop_front();
+      prefetchQueued.erase(name);
+
+      {
+        TP_MUTEX_UNLOCKER(prefetchMutex);
+        readAhead(listFilesRecursive(getPath(name)));
+      }
+    }
+  }
+
+  //################################################################################################
+  std::string getPath(const std::string& name) const
   {
     return path + "/" + name;
   }
 
   //################################################################################################
-  TPMutex& getMutex(const std::string& name, NameAction nameAction)
+  //! List the collections on disk, names starting with a '.' are used internally.
+  std::vector<std::string> listCollections() const
   {
-    TP_MUTEX_LOCKER(mutex);
+    std::vector<std::string> collections;
+    if(!versioned)
+    {
+      for(const auto& directory : tp_utils::listDirectories(path))
+      {
+        std::string name = fileName(directory);
+        if(validName(name))
+          collections.push_back(name);
+      }
+      return collections;
+    }
+
+    //Directories are collections that could not be moved into versions.
+    for(const auto& entry : listEntries(path))
+      if((entry.isSymLink || entry.isDirectory) && validName(entry.name))
+        collections.push_back(entry.name);
+    return collections;
+  }
+
+  //################################################################################################
+  //! Call closure with the directory that holds a collection, returns false if it does not exist.
+  /*!
+  Directories are written in place so they are read while holding the collection's mutex, versions
+  are never modified and are read while holding a shared lock on the version.
+  */
+  bool readCollection(const std::string& name,
+                      const std::function<void(const std::string&)>& closure)
+  {
+    if(!validName(name))
+      return false;
+
+    if(!versioned)
+    {
+      auto m = getMutex(name, NameAction::None);
+      if(!m)
+        return false;
+
+      TP_MUTEX_LOCKER(*m);
+      FileInfo info;
+      if(shared && !(fileInfo(getPath(name), info) && info.isDirectory))
+        return false;
+
+      closure(getPath(name));
+      return true;
+    }
 
-    if(nameAction!=NameAction::None)
+    if(!shared && !contains(name))
+      return false;
+
+    std::string previousVersion;
+    for(;;)
     {
-      bool add = (nameAction==NameAction::Add);
-      for(size_t n=0; n<names.size(); n++)
+      std::string version = versionOf(name);
+      if(version.empty() || version==previousVersion)
+        break;
+
+      //If the version was deleted before the lock was taken the link now points to a newer one.
+      FileInfo info;
+      bool found=false;
       {
-        if(names.at(n) == name)
+        FileLock versionLock(versionLockPath(version), false);
+        if(fileInfo(versionsPath() + "/" + version, info))
         {
-          add=false;
-          if(nameAction==NameAction::Remove)
-            tpRemoveAt(names, n);
-          break;
+          closure(versionsPath() + "/" + version);
+          found = true;
         }
       }
 
-      if(add)
-        names.push_back(name);
+      //This may have been the last reader of a version that we replaced.
+      if(hasRetired)
+        deleteRetired();
+
+      if(found)
+        return true;
+
+      previousVersion = version;
+    }
+
+    //A collection that has not been moved into a version, possibly because the store is read only.
+    FileInfo info;
+    if(!fileInfo(getPath(name), info) || !info.isDirectory || !readSymLink(getPath(name)).empty())
+      return false;
+
+    closure(getPath(name));
+    return true;
+  }
+
+  //################################################################################################
+  std::string poolPath() const
+  {
+    return path + "/.pool";
+  }
+
+  //################################################################################################
+  //! Held exclusively while pool entries are linked or removed, by all processes.
+  std::string poolLockPath() const
+  {
+    return path + "/.pool_lock";
+  }
+
+  //################################################################################################
+  std::string versionsPath() const
+  {
+    return path + "/.versions";
+  }
+
+  //################################################################################################
+  //! Held exclusively while a version is built and published, excludes writers in all processes.
+  std::string writeLockPath() const
+  {
+    return path + "/.write_lock";
+  }
+
+  //################################################################################################
+  //! Held shared while a checkpoint reads versions, versions are only deleted when it is free.
+  std::string checkpointLockPath() const
+  {
+    return path + "/.checkpoint_lock";
+  }
+
+  //################################################################################################
+  //! Held shared by readers of a version, the version is only deleted when it is free.
+  std::string versionLockPath(const std::string& version) const
+  {
+    return versionsPath() + "/" + version + ".lock";
+  }
+
+  //################################################################################################
+  std::string stagingPath() const
+  {
+    return path + "/.tmp";
+  }
+
+  //################################################################################################
+  //! Create a directory to save a collection to, named after the process to identify stale ones.
+  std::string makeStagingDirectory() const
+  {
+    return makeUniqueDirectory(stagingPath() + "/" + std::to_string(processID()) + "_");
+  }
+
+  //################################################################################################
+  //! Read the list of pool entries used by a version.
+  PoolRefs readRefs(const std::string& versionPath) const
+  {
+    PoolRefs refs;
+    std::vector<std::string> lines;
+    std::string data = tp_utils::readBinaryFile(versionPath + ".refs");
+    tpSplit(lines, data, '\n', tp_utils::SplitBehavior::SkipEmptyParts);
+    for(const auto& line : lines)
+    {
+      auto i = line.find(' ');
+      if(i != std::string::npos)
+        refs[line.substr(i+1)] = line.substr(0, i);
+    }
+    return refs;
+  }
+
+  //################################################################################################
+  bool writeRefs(const std::string& versionPath, const PoolRefs& refs) const
+  {
+    if(refs.empty())
+      return true;
+
+    std::string data;
+    for(const auto& ref : refs)
+      data += ref.second + ' ' + ref.first + '\n';
+    return tp_utils::writeBinaryFile(versionPath + ".refs", data);
+  }
+
+  //################################################################################################
+  //! Remove the pool entries in refs that no longer have any links other than the pool.
+  void releasePoolEntries(const PoolRefs& refs)
+  {
+    if(refs.empty())
+      return;
+
+    FileLock poolLock(poolLockPath(), true);
+    for(const auto& ref : refs)
+    {
+      std::string poolFile = poolPath() + "/" + ref.second;
+      FileInfo info;
+      if(fileInfo(poolFile, info) && info.links<=1)
+        removeFile(poolFile);
+    }
+  }
+
+  //################################################################################################
+  //! Delete a version, the caller should hold its lock exclusively or know it was never published.
+  void deleteVersion(const std::string& version)
+  {
+    std::string versionPath = versionsPath() + "/" + version;
+    PoolRefs refs = readRefs(versionPath);
+    tp_utils::rm(versionPath, true);
+    releasePoolEntries(refs);
+
+    //Removed last so that if we crash the pool entries are checked when the store next opens.
+    removeFile(versionPath + ".refs");
+    removeFile(versionLockPath(version));
+  }
+
+  //################################################################################################
+  //! Delete a version if no reader in any process is using it.
+  bool tryDeleteVersion(const std::string& version)
+  {
+    FileLock versionLock(versionLockPath(version), true, false);
+    if(!versionLock.locked)
+      return false;
+
+    deleteVersion(version);
+    return true;
+  }
+
+  //################################################################################################
+  //! Returns the name of the version directory a collection points to or an empty string.
+  std::string versionOf(const std::string& name) const
+  {
+    std::string target = readSymLink(getPath(name));
+    if(target.compare(0, 10, ".versions/") != 0 || target.find('/', 10) != std::string::npos)
+      return std::string();
+    return target.substr(10);
+  }
+
+  //################################################################################################
+  //! Point a collection at a version, the link is replaced atomically.
+  bool publish(const std::string& name, const std::string& version)
+  {
+    std::string linkPath = getPath(".link_" + version);
+    if(createSymLink(".versions/" + version, linkPath) && renamePath(linkPath, getPath(name)))
+      return true;
+
+    removeFile(linkPath);
+    return false;
+  }
+
+  //################################################################################################
+  //! Replace the files of a newly written collection with links to identical files in the pool.
+  /*!
+  Files are hashed and compared through a fixed size buffer so large members are never held in
+  memory.
+
+  \return The pool entries that the files now link to.
+  */
+  PoolRefs deduplicateFiles(const std::string& collectionPath)
+  {
+    PoolRefs refs;
+    tp_utils::mkdir(poolPath(), tp_utils::CreateFullPath::Yes);
+    usesPool = true;
+
+    std::string linkPath = collectionPath + "/.link";
+    for(const auto& file : listFilesRecursive(collectionPath))
+    {
+      std::string entry;
+      if(!poolName(file, entry))
+        continue;
+
+      std::string poolFile = poolPath() + "/" + entry;
+      std::string relativePath = file.substr(collectionPath.size()+1);
+
+      //Our own link keeps the pool entry alive while it is compared outside of the lock.
+      {
+        FileLock poolLock(poolLockPath(), true);
+
+        //A new payload, the staged file becomes the pool entry.
+        if(hardLink(file, poolFile))
+        {
+          refs[relativePath] = entry;
+          continue;
+        }
+
+        if(!hardLink(poolFile, linkPath))
+          continue;
+      }
+
+      //Compare the contents so that a hash collision can never corrupt a collection.
+      if(filesEqual(linkPath, file) && renamePath(linkPath, file))
+        refs[relativePath] = entry;
+      else
+        removeFile(linkPath);
+    }
+
+    return refs;
+  }
+
+  //################################################################################################
+  //! Publish a new version of a collection, or remove a collection if stagedPath is empty.
+  /*!
+  The new version starts as links to the files of the current version, the staged files are then
+  moved over them, this appends to the collection without writing to files that may be shared
+  with the pool, a checkpoint or a reader. The caller should hold the collection's mutex.
+
+  \param stagedRefs - The pool entries the staged files link to.
+  */
+  bool commit(const std::string& name, const std::string& stagedPath, const PoolRefs& stagedRefs)
+  {
+    std::string oldVersion;
+    {
+      FileLock writeLock(writeLockPath(), true);
+      oldVersion = versionOf(name);
+
+      if(!stagedPath.empty())
+      {
+        std::string versionPath = makeUniqueDirectory(versionsPath() + "/v_");
+        bool ok = !versionPath.empty();
+
+        //The new version uses the pool entries of the old files that are not replaced.
+        PoolRefs refs;
+        if(ok && !oldVersion.empty())
+        {
+          ok = linkTree(versionsPath() + "/" + oldVersion, versionPath);
+          refs = readRefs(versionsPath() + "/" + oldVersion);
+        }
+
+        for(const auto& file : listFilesRecursive(stagedPath))
+          refs.erase(file.substr(stagedPath.size()+1));
+        for(const auto& ref : stagedRefs)
+          refs[ref.first] = ref.second;
+
+        ok = ok &&
+            moveTree(stagedPath, versionPath) &&
+            writeRefs(versionPath, refs) &&
+            publish(name, fileName(versionPath));
+        tp_utils::rm(stagedPath, true);
+
+        if(!ok)
+        {
+          if(!versionPath.empty())
+            deleteVersion(fileName(versionPath));
+          releasePoolEntries(stagedRefs);
+          tpWarning() << "FileSystemStore failed to publish collection: " << name;
+          return false;
+        }
+      }
+      else if(!oldVersion.empty())
+        removeFile(getPath(name));
+    }
+
+    if(!oldVersion.empty())
+    {
+      {
+        TP_MUTEX_LOCKER(retiredMutex);
+        retired.push_back(oldVersion);
+        hasRetired = true;
+      }
+      deleteRetired();
+    }
+
+    return true;
+  }
+
+  //################################################################################################
+  //! Delete the replaced versions that are not being read or checkpointed.
+  /*!
+  Versions that are still in use are retried when their last reader in this process finishes, or
+  after the next commit or checkpoint. Versions left when the store closes are deleted when the
+  directory is next opened.
+  */
+  void deleteRetired()
+  {
+    std::vector<std::string> versions;
+    {
+      TP_MUTEX_LOCKER(retiredMutex);
+      versions.swap(retired);
+      hasRetired = false;
+    }
+
+    if(versions.empty())
+      return;
+
+    std::vector<std::string> inUse;
+    FileLock checkpointLock(checkpointLockPath(), true, false);
+    for(const auto& version : versions)
+      if(!checkpointLock.locked || !tryDeleteVersion(version))
+        inUse.push_back(version);
+
+    if(!inUse.empty())
+    {
+      TP_MUTEX_LOCKER(retiredMutex);
+      retired.insert(retired.end(), inUse.begin(), inUse.end());
+      hasRetired = true;
+    }
+  }
+
+  //################################################################################################
+  //! Capture which version each collection points to, this briefly excludes writers.
+  std::vector<std::pair<std::string, std::string>> listVersions()
+  {
+    std::vector<std::pair<std::string, std::string>> versions;
+    FileLock writeLock(writeLockPath(), true);
+    for(const auto& name : listCollections())
+    {
+      std::string version = versionOf(name);
+      if(!version.empty())
+        versions.emplace_back(name, version);
+    }
+    return versions;
+  }
+
+  //################################################################################################
+  //! Finish migrations that were interrupted by a crash, the caller holds the write lock.
+  void recoverVersions()
+  {
+    for(const auto& entry : listEntries(versionsPath()))
+    {
+      const auto& n = entry.name;
+      if(entry.isDirectory || n.size()<6 || n.compare(n.size()-5, 5, ".name") != 0)
+        continue;
+
+      std::string markerPath = versionsPath() + "/" + entry.name;
+      std::string version = entry.name.substr(0, entry.name.size()-5);
+      std::string name = tp_utils::readBinaryFile(markerPath);
+
+      FileInfo info;
+      if(!name.empty() && fileInfo(versionsPath() + "/" + version, info) &&
+         !fileInfo(getPath(name), info) && readSymLink(getPath(name)).empty())
+        publish(name, version);
+
+      removeFile(markerPath);
+    }
+  }
+
+  //################################################################################################
+  //! Collections written before versions were introduced are plain directories, move them.
+  void migrateDirectories()
+  {
+    for(const auto& entry : listEntries(path))
+    {
+      if(!entry.isDirectory || entry.name.empty() || entry.name.front()=='.')
+        continue;
+
+      std::string versionPath = makeUniqueDirectory(versionsPath() + "/v_");
+      if(versionPath.empty())
+        continue;
+
+      //The marker lets recoverVersions() publish the version if we crash after the rename.
+      std::string markerPath = versionPath + ".name";
+      if(!tp_utils::writeBinaryFile(markerPath, entry.name) ||
+         !renamePath(getPath(entry.name), versionPath) ||
+         !publish(entry.name, fileName(versionPath)))
+        tpWarning() << "FileSystemStore failed to migrate collection: " << entry.name;
+
+      removeFile(markerPath);
+    }
+  }
+
+  //################################################################################################
+  //! Delete versions that no collection points to, the caller holds the write and checkpoint locks.
+  void removeUnreferencedVersions()
+  {
+    std::unordered_set<std::string> referenced;
+    for(const auto& name : listCollections())
+      referenced.insert(versionOf(name));
+
+    //Reference lists and locks without a version are from a crash while it was being deleted.
+    std::unordered_set<std::string> unreferenced;
+    for(const auto& entry : listEntries(versionsPath()))
+    {
+      std::string version = entry.name;
+      if(!entry.isDirectory)
+      {
+        auto dot = version.rfind('.');
+        if(dot == std::string::npos)
+          continue;
+
+        std::string suffix = version.substr(dot);
+        if(suffix != ".refs" && suffix != ".lock")
+          continue;
+        version.resize(dot);
+      }
+
+      if(referenced.find(version) == referenced.end())
+        unreferenced.insert(version);
+    }
+
+    //Replaced versions that another process is still reading are left for it to delete.
+    for(const auto& version : unreferenced)
+      tryDeleteVersion(version);
+  }
+
+  //################################################################################################
+  void collectGarbage()
+  {
+    if(!usesPool)
+      return;
+
+    FileLock poolLock(poolLockPath(), true);
+    for(const auto& file : listFilesRecursive(poolPath()))
+    {
+      FileInfo info;
+      if(fileInfo(file, info) && info.links<=1)
+        tp_utils::rm(file, false);
+    }
+  }
+
+  //################################################################################################
+  //! Returns true if the collection exists, only shared stores need to check the file system.
+  bool contains(const std::string& name)
+  {
+    if(shared)
+    {
+      FileInfo info;
+      return validName(name) && fileInfo(getPath(name), info) && info.isDirectory;
     }
 
+    TP_MUTEX_LOCKER(mutex);
+    return nameSet.find(name) != nameSet.end();
+  }
+
+  //################################################################################################
+  //! Returns the mutex for a collection, or nullptr if the collection does not exist.
+  /*!
+  Add will always return a mutex, None and Remove return nullptr for collections that are not in
+  the store, this means misses never touch the file system. The names are not modified, call
+  updateNames() once the change has been committed. Shared stores don't hold the names in memory as
+  other processes may change them, so they always return a mutex.
+  */
+  TPMutex* getMutex(const std::string& name, NameAction nameAction)
+  {
+    TP_MUTEX_LOCKER(mutex);
+
+    if(nameAction!=NameAction::Add && !shared && nameSet.find(name) == nameSet.end())
+      return nullptr;
+
     auto& m = mutexes[name];
     if(!m)
       m.reset(new TPMutex(TPM));
-    return *m;
+    return m.get();
+  }
+
+  //################################################################################################
+  //! Add or remove a name after the change to the collection has been committed.
+  void updateNames(const std::string& name, NameAction nameAction)
+  {
+    if(shared)
+      return;
+
+    TP_MUTEX_LOCKER(mutex);
+    if(nameAction==NameAction::Add)
+    {
+      if(nameSet.insert(name).second)
+        names.push_back(name);
+    }
+    else if(nameAction==NameAction::Remove)
+    {
+      if(nameSet.erase(name))
+        tpRemoveOne(names, name);
+    }
   }
 };
 
 //##################################################################################################
 FileSystemStore::FileSystemStore(const tp_data::CollectionFactory* collectionFactory,
-                                 const std::string& path):
+                                 const std::string& path,
+                                 Layout layout,
+                                 bool shared):
   AbstractStore(collectionFactory),
-  d(new Private(path))
+  d(new Private(path, layout, shared))
 {
 
 }
@@ -88,21 +850,66 @@ FileSystemStore::~FileSystemStore()
 void FileSystemStore::add(const std::string& name,
                           const tp_data::Collection& collection)
 {
-  TP_MUTEX_LOCKER(d->getMutex(name, NameAction::Add));
+  if(!validName(name))
+  {
+    tpWarning() << "FileSystemStore::add Error: Invalid name: " << name;
+    return;
+  }
+
+  TP_MUTEX_LOCKER(*d->getMutex(name, NameAction::Add));
+
   std::string error;
-  collectionFactory()->saveToPath(error, collection, d->getPath(name), true);
+  if(!d->versioned)
+  {
+    collectionFactory()->saveToPath(error, collection, d->getPath(name), true);
+    if(!error.empty())
+      tpWarning() << "FileSystemStore::add Error: " << error;
+    else
+      d->updateNames(name, NameAction::Add);
+    return;
+  }
+
+  //Files are never modified in place, they may be shared with the pool or with checkpoints.
+  std::string stagedPath = d->makeStagingDirectory();
+  if(stagedPath.empty())
+  {
+    tpWarning() << "FileSystemStore::add Error: Failed to create staging directory.";
+    return;
+  }
+
+  collectionFactory()->saveToPath(error, collection, stagedPath, true);
   if(!error.empty())
+  {
     tpWarning() << "FileSystemStore::add Error: " << error;
+    tp_utils::rm(stagedPath, true);
+    return;
+  }
+
+  PoolRefs stagedRefs;
+  if(d->deduplicate)
+    stagedRefs = d->deduplicateFiles(stagedPath);
+  if(d->commit(name, stagedPath, stagedRefs))
+    d->updateNames(name, NameAction::Add);
 }
 
 //##################################################################################################
 void FileSystemStore::remove(const std::string& name)
 {
-  if(name.empty())
+  if(!validName(name))
     return;
 
-  TP_MUTEX_LOCKER(d->getMutex(name, NameAction::Remove));
-  tp_utils::rm(d->getPath(name), true);
+  auto m = d->getMutex(name, NameAction::Remove);
+  if(!m)
+    return;
+
+  TP_MUTEX_LOCKER(*m);
+  if(!d->versioned)
+  {
+    tp_utils::rm(d->getPath(name), true);
+    d->updateNames(name, NameAction::Remove);
+  }
+  else if(d->commit(name, std::string(), PoolRefs()))
+    d->updateNames(name, NameAction::Remove);
 }
 
 //##################################################################################################
@@ -110,18 +917,244 @@ void FileSystemStore::fetch(const std::string& name,
                             tp_data::Collection& collection,
                             const std::vector<std::string>& subset)
 {
-  TP_MUTEX_LOCKER(d->getMutex(name, NameAction::None));
-  std::string error;
-  collectionFactory()->loadFromPath(error, d->getPath(name), collection, subset);
-  if(!error.empty())
-    tpWarning() << "FileSystemStore::fetch Error: " << error;
+  tryFetch(name, collection, subset);
+}
+
+//##################################################################################################
+bool FileSystemStore::tryFetch(const std::string& name,
+                               tp_data::Collection& collection,
+                               const std::vector<std::string>& subset)
+{
+  return d->readCollection(name, [&](const std::string& collectionPath)
+  {
+    std::string error;
+    collectionFactory()->loadFromPath(error, collectionPath, collection, subset);
+    if(!error.empty())
+      tpWarning() << "FileSystemStore::fetch Error: " << error;
+  });
+}
+
+//##################################################################################################
+bool FileSystemStore::exists(const std::string& name)
+{
+  return d->contains(name);
+}
+
+//##################################################################################################
+void FileSystemStore::prefetch(const std::vector<std::string>& names)
+{
+  std::vector<std::string> prefetchNames;
+  for(const auto& name : names)
+    if(d->contains(name))
+      prefetchNames.push_back(name);
+
+  if(!prefetchNames.empty())
+    d->queuePrefetch(prefetchNames);
 }
 
 //##################################################################################################
 void FileSystemStore::viewNames(const std::function<void(const std::vector<std::string>&)>& closure)
 {
+  if(d->shared)
+  {
+    closure(d->listCollections());
+    return;
+  }
+
   TP_MUTEX_LOCKER(d->mutex);
   closure(d->names);
 }
 
+//##################################################################################################
+bool FileSystemStore::fetchPacked(std::string& error,
+                                  const std::string& name,
+                                  std::string& data,
+                                  const std::vector<std::string>& subset)
+{
+  //Only the files of the members in the subset should be sent, but only the factory knows which
+  //files those are.
+  if(!subset.empty())
+    return AbstractStore::fetchPacked(error, name, data, subset);
+
+  return d->readCollection(name, [&](const std::string& collectionPath)
+  {
+    packFiles(collectionPath, data);
+  });
+}
+
+//##################################################################################################
+void FileSystemStore::addPacked(const std::string& name, const std::string& data)
+{
+  if(!validName(name))
+  {
+    tpWarning() << "FileSystemStore::addPacked Error: Invalid name: " << name;
+    return;
+  }
+
+  TP_MUTEX_LOCKER(*d->getMutex(name, NameAction::Add));
+
+  std::string error;
+  if(!d->versioned)
+  {
+    unpackFiles(error, data, d->getPath(name));
+    if(!error.empty())
+      tpWarning() << "FileSystemStore::addPacked Error: " << error;
+    else
+      d->updateNames(name, NameAction::Add);
+    return;
+  }
+
+  std::string stagedPath = d->makeStagingDirectory();
+  if(stagedPath.empty())
+  {
+    tpWarning() << "FileSystemStore::addPacked Error: Failed to create staging directory.";
+    return;
+  }
+
+  unpackFiles(error, data, stagedPath);
+  if(!error.empty())
+  {
+    tpWarning() << "FileSystemStore::addPacked Error: " << error;
+    tp_utils::rm(stagedPath, true);
+    return;
+  }
+
+  PoolRefs stagedRefs;
+  if(d->deduplicate)
+    stagedRefs = d->deduplicateFiles(stagedPath);
+  if(d->commit(name, stagedPath, stagedRefs))
+    d->updateNames(name, NameAction::Add);
+}
+
+//##################################################################################################
+void FileSystemStore::setDeduplicate(bool deduplicate)
+{
+  if(deduplicate && !d->versioned)
+  {
+    tpWarning() << "FileSystemStore::setDeduplicate Error: Requires the versioned layout.";
+    return;
+  }
+
+  d->deduplicate = deduplicate;
+}
+
+//##################################################################################################
+bool FileSystemStore::deduplicate() const
+{
+  return d->deduplicate;
+}
+
+//##################################################################################################
+DeduplicationStats FileSystemStore::deduplicationStats()
+{
+  DeduplicationStats stats;
+  std::unordered_set<std::string> entries;
+
+  FileLock checkpointLock(d->checkpointLockPath(), false);
+  for(const auto& version : d->listVersions())
+  {
+    for(const auto& ref : d->readRefs(d->versionsPath() + "/" + version.second))
+    {
+      FileInfo info;
+      if(!fileInfo(d->poolPath() + "/" + ref.second, info))
+        continue;
+
+      stats.referencedFiles++;
+      stats.logicalBytes += info.size;
+      if(entries.insert(ref.second).second)
+      {
+        stats.pooledFiles++;
+        stats.storedBytes += info.size;
+      }
+    }
+  }
+
+  return stats;
+}
+
+//##################################################################################################
+void FileSystemStore::collectGarbage()
+{
+  d->collectGarbage();
+}
+
+//##################################################################################################
+bool FileSystemStore::checkpoint(const std::string& targetPath)
+{
+  if(!d->versioned)
+  {
+    tpWarning() << "FileSystemStore::checkpoint Error: Requires the versioned layout.";
+    return false;
+  }
+
+  FileInfo info;
+  bool replace = fileInfo(targetPath, info);
+  if(replace && !fileInfo(targetPath + "/.versions", info))
+  {
+    tpWarning() << "FileSystemStore::checkpoint Error: Target is not a checkpoint: " << targetPath;
+    return false;
+  }
+
+  //Built next to the target and swapped into place so a partial checkpoint is never visible.
+  std::string buildPath = targetPath + ".partial";
+  tp_utils::rm(buildPath, true);
+  bool ok = tp_utils::mkdir(buildPath + "/.versions", tp_utils::CreateFullPath::Yes);
+
+  std::unordered_set<std::string> linkedVersions;
+  {
+    FileLock checkpointLock(d->checkpointLockPath(), false);
+
+    auto versions = d->listVersions();
+    for(size_t i=0; i<versions.size() && ok; i++)
+    {
+      const auto& name = versions.at(i).first;
+      const auto& version = versions.at(i).second;
+
+      //Versions that are already in the previous checkpoint are linked from there, this avoids
+      //copying them again if the target is on a different file system.
+      std::string previousPath = targetPath + "/.versions/" + version;
+      std::string sourcePath = d->versionsPath() + "/" + version;
+      if(replace && fileInfo(previousPath, info))
+        sourcePath = previousPath;
+
+      //The reference list is linked too so dropping the version later can release pool entries.
+      std::string versionPath = buildPath + "/.versions/" + version;
+      ok = tp_utils::mkdir(versionPath, tp_utils::CreateFullPath::Yes) &&
+          linkTree(sourcePath, versionPath) &&
+          createSymLink(".versions/" + version, buildPath + "/" + name);
+
+      if(ok && fileInfo(sourcePath + ".refs", info))
+        ok = linkOrCloneFile(sourcePath + ".refs", versionPath + ".refs");
+      linkedVersions.insert(version);
+    }
+  }
+
+  if(ok)
+    ok = replace?exchangePaths(buildPath, targetPath):renamePath(buildPath, targetPath);
+
+  //After the exchange buildPath holds the previous checkpoint, the pool entries used by versions
+  //that are not in the new one may now be unreferenced.
+  PoolRefs droppedRefs;
+  if(ok && replace)
+  {
+    for(const auto& entry : listEntries(buildPath + "/.versions"))
+    {
+      if(!entry.isDirectory || linkedVersions.find(entry.name) != linkedVersions.end())
+        continue;
+
+      for(const auto& ref : d->readRefs(buildPath + "/.versions/" + entry.name))
+        droppedRefs[entry.name + "/" + ref.first] = ref.second;
+    }
+  }
+
+  tp_utils::rm(buildPath, true);
+  d->releasePoolEntries(droppedRefs);
+
+  if(!ok)
+    tpWarning() << "FileSystemStore::checkpoint Error: Failed to write: " << targetPath;
+
+  d->deleteRetired();
+  return ok;
+}
+
 }
@@ -54,6 +54,19 @@ struct RAMStore::Private
     return collectionDetails;
   }
 
+  //################################################################################################
+  //! Like collectionDetails() but returns nullptr for missing collections rather than adding them.
+  CollectionDetails_lt* findCollectionDetails(const std::string& name)
+  {
+    TP_MUTEX_LOCKER(mutex);
+    auto i = collections.find(name);
+    if(i == collections.end() || i->second->remove)
+      return nullptr;
+
+    i->second->count++;
+    return i->second;
+  }
+
   //################################################################################################
   void returnCollectionDetails(CollectionDetails_lt* collectionDetails)
   {
@@ -113,7 +126,10 @@ void RAMStore::add(const std::string& name,
 //##################################################################################################
 void RAMStore::remove(const std::string& name)
 {
-  auto collectionDetails = d->collectionDetails(name);
+  auto collectionDetails = d->findCollectionDetails(name);
+  if(!collectionDetails)
+    return;
+
   TP_CLEANUP([&]{d->returnCollectionDetails(collectionDetails);});
   collectionDetails->remove = true;
 }
@@ -123,13 +139,33 @@ void RAMStore::fetch(const std::string& name,
                      tp_data::Collection& collection,
                      const std::vector<std::string>& subset)
 {
-  auto collectionDetails = d->collectionDetails(name);
+  tryFetch(name, collection, subset);
+}
+
+//##################################################################################################
+bool RAMStore::tryFetch(const std::string& name,
+                        tp_data::Collection& collection,
+                        const std::vector<std::string>& subset)
+{
+  auto collectionDetails = d->findCollectionDetails(name);
+  if(!collectionDetails)
+    return false;
+
   TP_CLEANUP([&]{d->returnCollectionDetails(collectionDetails);});
   TP_MUTEX_LOCKER(collectionDetails->mutex);
   std::string error;
   collectionFactory()->cloneAppend(error, collectionDetails->collection, collection, subset);
   if(!error.empty())
     tpWarning() << "RAMStore::fetch: " << error;
+  return true;
+}
+
+//##################################################################################################
+bool RAMStore::exists(const std::string& name)
+{
+  TP_MUTEX_LOCKER(d->mutex);
+  auto i = d->collections.find(name);
+  return i != d->collections.end() && !i->second->remove;
 }
 
 //##################################################################################################
@@ -0,0 +1,579 @@
+#include "tp_data_store/stores/RemoteStore.h"
+#include "tp_data_store/StoreProtocol.h"
+
+#include "tp_data/Collection.h"
+#include "tp_data/CollectionFactory.h"
+
+#include "tp_utils/MutexUtils.h"
+#include "tp_utils/DebugUtils.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+namespace tp_data_store
+{
+
+namespace
+{
+//The maximum number of requests that are sent before reading a response, this stops the client
+//and server from both blocking on full socket buffers.
+constexpr size_t pipelineDepth = 64;
+
+//The maximum number of prefetched collections to hold that have not been fetched yet.
+constexpr size_t maxPrefetched = 256;
+
+//Prefetched collections older than this are discarded, other clients may have changed them.
+constexpr std::chrono::seconds maxPrefetchAge{2};
+
+//##################################################################################################
+struct Prefetched_lt
+{
+  std::string data;
+  std::chrono::steady_clock::time_point time;
+};
+
+//##################################################################################################
+std::string makeRequest(StoreOp op)
+{
+  std::string request;
+  ProtocolWriter(request).writeUInt8(uint8_t(op));
+  return request;
+}
+
+//##################################################################################################
+std::string makeRequest(StoreOp op, const std::string& name)
+{
+  std::string request = makeRequest(op);
+  ProtocolWriter(request).writeString(name);
+  return request;
+}
+}
+
+//##################################################################################################
+struct RemoteStore::Private
+{
+  std::string address;
+
+  TPMutex mutex{TPM};
+  std::vector<int> connections;
+  std::unordered_map<std::string, Prefetched_lt> prefetched;
+
+  //The token of the prefetch in flight for each name, a response is only kept if it still matches.
+  std::unordered_map<std::string, uint64_t> prefetching;
+  uint64_t prefetchToken{0};
+
+  TPMutex prefetchMutex{TPM};
+  TPWaitCondition prefetchWaitCondition;
+  std::deque<std::string> prefetchQueue;
+  std::unordered_set<std::string> prefetchQueued;
+  std::unique_ptr<std::thread> prefetchThread;
+  bool finish{false};
+
+  //################################################################################################
+  Private(const std::string& address_):
+    address(address_)
+  {
+
+  }
+
+  //################################################################################################
+  ~Private()
+  {
+    {
+      TP_MUTEX_LOCKER(prefetchMutex);
+      finish = true;
+    }
+    prefetchWaitCondition.wakeAll();
+
+    if(prefetchThread)
+      prefetchThread->join();
+
+    for(auto fd : connections)
+      closeSocket(fd);
+  }
+
+  //################################################################################################
+  //! Take an idle connection or open a new one, returns -1 on failure.
+  /*!
+  \param reused - Set true if an idle connection was returned, the server may have closed it.
+  */
+  int takeConnection(bool& reused)
+  {
+    {
+      TP_MUTEX_LOCKER(mutex);
+      reused = !connections.empty();
+      if(reused)
+      {
+        int fd = connections.back();
+        connections.pop_back();
+        return fd;
+      }
+    }
+
+    std::string error;
+    int fd = connectToAddress(error, address);
+    if(fd<0)
+      tpWarning() << "RemoteStore failed to connect to: " << address << " Error: " << error;
+    return fd;
+  }
+
+  //################################################################################################
+  void returnConnection(int fd)
+  {
+    TP_MUTEX_LOCKER(mutex);
+    connections.push_back(fd);
+  }
+
+  //################################################################################################
+  void closeIdleConnections()
+  {
+    std::vector<int> idle;
+    {
+      TP_MUTEX_LOCKER(mutex);
+      idle.swap(connections);
+    }
+
+    for(auto fd : idle)
+      closeSocket(fd);
+  }
+
+  //################################################################################################
+  //! Send a batch of requests on one connection and pass each response to closure in order.
+  /*!
+  \param requests - Requests without the request id, see makeRequest().
+  \param closure - Called with the index of the request, the status, and a reader for the payload.
+  \return false if the connection failed, in which case not all responses will have been read.
+  */
+  bool run(const std::vector<std::string>& requests,
+           const std::function<void(size_t, StoreStatus, ProtocolReader&)>& closure)
+  {
+    if(requests.empty())
+      return true;
+
+    bool reused=false;
+    int fd = takeConnection(reused);
+    if(fd<0)
+      return false;
+
+    size_t received=0;
+    if(exchange(fd, requests, closure, received))
+      return true;
+
+    //Idle connections fail once the server has restarted, if nothing was answered send the
+    //requests again on a new connection. The other idle connections are likely to be stale too.
+    if(!reused || received>0)
+      return failed(fd);
+
+    closeSocket(fd);
+    closeIdleConnections();
+
+    fd = takeConnection(reused);
+    if(fd<0)
+      return false;
+
+    return exchange(fd, requests, closure, received) || failed(fd);
+  }
+
+  //################################################################################################
+  //! Send requests and read the responses, the connection is returned to the pool on success.
+  /*!
+  \param received - Set to the number of responses that were passed to closure.
+  \return false if the connection failed, fd is left open for the caller to close.
+  */
+  bool exchange(int fd,
+                const std::vector<std::string>& requests,
+                const std::function<void(size_t, StoreStatus, ProtocolReader&)>& closure,
+                size_t& received)
+  {
+    std::string frame;
+    std::string response;
+    size_t sent=0;
+    received=0;
+    while(received<requests.size())
+    {
+      for(; sent<requests.size() && (sent-received)<pipelineDepth; sent++)
+      {
+        frame.clear();
+        ProtocolWriter writer(frame);
+        writer.writeUInt32(uint32_t(sent));
+        frame += requests.at(sent);
+        if(!writeFrame(fd, frame))
+          return false;
+      }
+
+      if(!readFrame(fd, response))
+        return false;
+
+      ProtocolReader reader(response);
+      uint32_t id = reader.readUInt32();
+      auto status = StoreStatus(reader.readUInt8());
+      if(!reader.ok() || id!=received)
+        return false;
+
+      if(status == StoreStatus::Error)
+        tpWarning() << "RemoteStore Error: " << reader.readString();
+
+      closure(received, status, reader);
+      received++;
+    }
+
+    returnConnection(fd);
+    return true;
+  }
+
+  //################################################################################################
+  bool failed(int fd)
+  {
+    tpWarning() << "RemoteStore lost connection to: " << address;
+    closeSocket(fd);
+    return false;
+  }
+
+  //################################################################################################
+  //! Returns true if name was prefetched recently, the data is removed from the prefetch cache.
+  bool takePrefetched(const std::string& name, std::string& data)
+  {
+    TP_MUTEX_LOCKER(mutex);
+    auto i = prefetched.find(name);
+    if(i == prefetched.end())
+      return false;
+
+    bool fresh = (std::chrono::steady_clock::now() - i->second.time) < maxPrefetchAge;
+    if(fresh)
+      data = std::move(i->second.data);
+    prefetched.erase(i);
+    return fresh;
+  }
+
+  //################################################################################################
+  //! Discard prefetched data and cancel in flight prefetches for name.
+  /*!
+  This is called before and after modifying or fetching a collection. Before stops responses to
+  earlier prefetches being kept, after catches prefetches sent while the request was in flight.
+  */
+  void forgetPrefetched(const std::string& name)
+  {
+    TP_MUTEX_LOCKER(mutex);
+    prefetched.erase(name);
+    prefetching.erase(name);
+  }
+
+  //################################################################################################
+  //! Drop expired entries, must be called with mutex locked.
+  void removeExpiredPrefetched()
+  {
+    auto now = std::chrono::steady_clock::now();
+    for(auto i=prefetched.begin(); i!=prefetched.end();)
+    {
+      if((now - i->second.time) >= maxPrefetchAge)
+        i = prefetched.erase(i);
+      else
+        ++i;
+    }
+  }
+
+  //################################################################################################
+  void queuePrefetch(const std::vector<std::string>& names)
+  {
+    {
+      TP_MUTEX_LOCKER(prefetchMutex);
+      for(const auto& name : names)
+        if(prefetchQueue.size()<maxPrefetched && prefetchQueued.insert(name).second)
+          prefetchQueue.push_back(name);
+
+      if(!prefetchThread)
+        prefetchThread.reset(new std::thread([&]{runPrefetch();}));
+    }
+    prefetchWaitCondition.wakeAll();
+  }
+
+  //################################################################################################
+  void runPrefetch()
+  {
+    TP_MUTEX_LOCKER(prefetchMutex);
+    for(;;)
+    {
+      while(!finish && prefetchQueue.empty())
+        prefetchWaitCondition.wait(TPMc prefetchMutex);
+
+      if(finish)
+        return;
+
+      std::vector<std::string> names(prefetchQueue.begin(), prefetchQueue.end());
+      prefetchQueue.clear();
+      prefetchQueued.clear();
+
+      {
+        TP_MUTEX_UNLOCKER(prefetchMutex);
+        prefetchNames(names);
+      }
+    }
+  }
+
+  //################################################################################################
+  //! Fetch collections into the prefetch cache.
+  /*!
+  Names that are already cached or in flight are skipped, and names that would not fit in the cache
+  are dropped rather than fetched and thrown away.
+  */
+  void prefetchNames(const std::vector<std::string>& queued)
+  {
+    std::vector<std::string> names;
+    std::vector<uint64_t> tokens;
+    {
+      TP_MUTEX_LOCKER(mutex);
+      removeExpiredPrefetched();
+
+      size_t used = prefetched.size() + prefetching.size();
+      for(size_t i=0; i<queued.size() && used<maxPrefetched; i++)
+      {
+        const auto& name = queued.at(i);
+        if(prefetched.find(name) != prefetched.end() || prefetching.find(name) != prefetching.end())
+          continue;
+
+        names.push_back(name);
+        tokens.push_back(++prefetchToken);
+        prefetching[name] = tokens.back();
+        used++;
+      }
+    }
+
+    std::vector<std::string> requests;
+    requests.reserve(names.size());
+    for(const auto& name : names)
+    {
+      requests.push_back(makeRequest(StoreOp::Fetch, name));
+      ProtocolWriter(requests.back()).writeStrings(std::vector<std::string>());
+    }
+
+    run(requests, [&](size_t i, StoreStatus status, ProtocolReader& reader)
+    {
+      std::string data;
+      if(status == StoreStatus::OK)
+        data = reader.readString();
+
+      TP_MUTEX_LOCKER(mutex);
+      auto t = prefetching.find(names.at(i));
+      if(t == prefetching.end() || t->second != tokens.at(i))
+        return;
+      prefetching.erase(t);
+
+      if(status != StoreStatus::OK)
+        return;
+
+      if(prefetched.size()>=maxPrefetched)
+        removeExpiredPrefetched();
+
+      if(prefetched.size()<maxPrefetched)
+        prefetched[names.at(i)] = {std::move(data), std::chrono::steady_clock::now()};
+    });
+
+    //Clear the tokens of any requests that were not answered.
+    TP_MUTEX_LOCKER(mutex);
+    for(size_t i=0; i<names.size(); i++)
+    {
+      auto t = prefetching.find(names.at(i));
+      if(t != prefetching.end() && t->second == tokens.at(i))
+        prefetching.erase(t);
+    }
+  }
+};
+
+//##################################################################################################
+RemoteStore::RemoteStore(const tp_data::CollectionFactory* collectionFactory,
+                         const std::string& address):
+  AbstractStore(collectionFactory),
+  d(new Private(address))
+{
+
+}
+
+//##################################################################################################
+RemoteStore::~RemoteStore()
+{
+  delete d;
+}
+
+//##################################################################################################
+void RemoteStore::add(const std::string& name,
+                      const tp_data::Collection& collection)
+{
+  std::string error;
+  std::string data;
+  saveCollectionToData(error, collectionFactory(), collection, data);
+  if(!error.empty())
+  {
+    tpWarning() << "RemoteStore::add Error: " << error;
+    return;
+  }
+
+  d->forgetPrefetched(name);
+
+  std::string request = makeRequest(StoreOp::Add, name);
+  ProtocolWriter(request).writeString(data);
+  if(request.size()>maxFrameSize-sizeof(uint32_t))
+  {
+    tpWarning() << "RemoteStore::add Error: Collection too large to send: " << name;
+    return;
+  }
+
+  d->run({request}, [](size_t, StoreStatus, ProtocolReader&){});
+
+  d->forgetPrefetched(name);
+}
+
+//##################################################################################################
+void RemoteStore::remove(const std::string& name)
+{
+  d->forgetPrefetched(name);
+  d->run({makeRequest(StoreOp::Remove, name)}, [](size_t, StoreStatus, ProtocolReader&){});
+  d->forgetPrefetched(name);
+}
+
+//##################################################################################################
+void RemoteStore::fetch(const std::string& name,
+                        tp_data::Collection& collection,
+                        const std::vector<std::string>& subset)
+{
+  tryFetch(name, collection, subset);
+}
+
+//##################################################################################################
+void RemoteStore::fetch(const std::vector<std::string>& names,
+                        std::vector<std::shared_ptr<tp_data::Collection>>& collections,
+                        const std::vector<std::string>& subset)
+{
+  collections.clear();
+  collections.resize(names.size());
+
+  std::vector<std::string> requests;
+  std::vector<size_t> indexes;
+  for(size_t i=0; i<names.size(); i++)
+  {
+    std::string data;
+    if(d->takePrefetched(names.at(i), data))
+    {
+      std::string error;
+      collections.at(i).reset(new tp_data::Collection());
+      loadCollectionFromData(error, collectionFactory(), data, *collections.at(i), subset);
+      if(!error.empty())
+        tpWarning() << "RemoteStore::fetch Error: " << error;
+      continue;
+    }
+
+    d->forgetPrefetched(names.at(i));
+    requests.push_back(makeRequest(StoreOp::Fetch, names.at(i)));
+    ProtocolWriter(requests.back()).writeStrings(subset);
+    indexes.push_back(i);
+  }
+
+  d->run(requests, [&](size_t i, StoreStatus status, ProtocolReader& reader)
+  {
+    d->forgetPrefetched(names.at(indexes.at(i)));
+    if(status != StoreStatus::OK)
+      return;
+
+    std::string error;
+    auto& collection = collections.at(indexes.at(i));
+    collection.reset(new tp_data::Collection());
+    loadCollectionFromData(error, collectionFactory(), reader.readString(), *collection, subset);
+    if(!error.empty())
+      tpWarning() << "RemoteStore::fetch Error: " << error;
+  });
+}
+
+//##################################################################################################
+bool RemoteStore::tryFetch(const std::string& name,
+                           tp_data::Collection& collection,
+                           const std::vector<std::string>& subset)
+{
+  std::string error;
+  std::string data;
+  bool found = d->takePrefetched(name, data);
+
+  if(!found)
+  {
+    d->forgetPrefetched(name);
+
+    std::string request = makeRequest(StoreOp::Fetch, name);
+    ProtocolWriter(request).writeStrings(subset);
+    d->run({request}, [&](size_t, StoreStatus status, ProtocolReader& reader)
+    {
+      if(status != StoreStatus::OK)
+        return;
+
+      found = true;
+      data = reader.readString();
+    });
+
+    d->forgetPrefetched(name);
+  }
+
+  if(!found)
+    return false;
+
+  loadCollectionFromData(error, collectionFactory(), data, collection, subset);
+  if(!error.empty())
+    tpWarning() << "RemoteStore::fetch Error: " << error;
+  return true;
+}
+
+//##################################################################################################
+bool RemoteStore::exists(const std::string& name)
+{
+  bool found=false;
+  d->run({makeRequest(StoreOp::Exists, name)}, [&](size_t, StoreStatus status, ProtocolReader&)
+  {
+    found = (status == StoreStatus::OK);
+  });
+  return found;
+}
+
+//##################################################################################################
+void RemoteStore::prefetch(const std::vector<std::string>& names)
+{
+  if(!names.empty())
+    d->queuePrefetch(names);
+}
+
+//##################################################################################################
+void RemoteStore::viewNames(const std::function<void(const std::vector<std::string>&)>& closure)
+{
+  std::vector<std::string> names;
+  d->run({makeRequest(StoreOp::ViewNames)}, [&](size_t, StoreStatus status, ProtocolReader& reader)
+  {
+    if(status == StoreStatus::OK)
+      names = reader.readStrings();
+  });
+  closure(names);
+}
+
+//##################################################################################################
+std::vector<MultiName> RemoteStore::fetchNames(const std::vector<std::string>& andNames)
+{
+  std::vector<MultiName> multiNames;
+
+  std::string request = makeRequest(StoreOp::FetchNames);
+  ProtocolWriter(request).writeStrings(andNames);
+  d->run({request}, [&](size_t, StoreStatus status, ProtocolReader& reader)
+  {
+    if(status != StoreStatus::OK)
+      return;
+
+    size_t count = reader.readUInt32();
+    for(size_t i=0; i<count && reader.ok(); i++)
+    {
+      multiNames.push_back(MultiName());
+      auto& multiName = multiNames.back();
+      multiName.name = reader.readString();
+      multiName.names = reader.readStrings();
+    }
+  });
+
+  return multiNames;
+}
+
+}
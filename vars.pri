@@ -12,6 +12,15 @@ HEADERS += inc/tp_data_store/AbstractStore.h
 SOURCES += src/MultiNameStore.cpp
 HEADERS += inc/tp_data_store/MultiNameStore.h
 
+SOURCES += src/PathUtils.cpp
+HEADERS += src/PathUtils.h
+
+SOURCES += src/StoreProtocol.cpp
+HEADERS += inc/tp_data_store/StoreProtocol.h
+
+SOURCES += src/StoreServer.cpp
+HEADERS += inc/tp_data_store/StoreServer.h
+
 #-- Stores -----------------------------------------------------------------------------------------
 SOURCES += src/stores/RAMStore.cpp
 HEADERS += inc/tp_data_store/stores/RAMStore.h
@@ -19,3 +28,5 @@ HEADERS += inc/tp_data_store/stores/RAMStore.h
 SOURCES += src/stores/FileSystemStore.cpp
 HEADERS += inc/tp_data_store/stores/FileSystemStore.h
 
+SOURCES += src/stores/RemoteStore.cpp
+HEADERS += inc/tp_data_store/stores/RemoteStore.h